@@ -5,28 +5,61 @@
 /* Low-level system call invocation */
 static inline int syscall0(int num) {
     int ret;
-    __asm__ volatile("int $0x80" : "=a"(ret) : "a"(num));
+    __asm__ volatile("int $0x80" : "=a"(ret) : "a"(num) : "memory");
     return ret;
 }
 
 static inline int syscall1(int num, uint32_t arg1) {
     int ret;
-    __asm__ volatile("int $0x80" : "=a"(ret) : "a"(num), "b"(arg1));
+    __asm__ volatile("int $0x80" : "=a"(ret) : "a"(num), "b"(arg1) : "memory");
     return ret;
 }
 
 static inline int syscall2(int num, uint32_t arg1, uint32_t arg2) {
     int ret;
-    __asm__ volatile("int $0x80" : "=a"(ret) : "a"(num), "b"(arg1), "c"(arg2));
+    __asm__ volatile("int $0x80" : "=a"(ret) : "a"(num), "b"(arg1), "c"(arg2) : "memory");
     return ret;
 }
 
 static inline int syscall3(int num, uint32_t arg1, uint32_t arg2, uint32_t arg3) {
     int ret;
-    __asm__ volatile("int $0x80" : "=a"(ret) : "a"(num), "b"(arg1), "c"(arg2), "d"(arg3));
+    __asm__ volatile("int $0x80" : "=a"(ret) : "a"(num), "b"(arg1), "c"(arg2), "d"(arg3) : "memory");
     return ret;
 }
 
+/* Startup data from the kernel */
+char** environ = NULL;
+static uint32_t* aux_vector = NULL;
+
+/* Record the environment and auxiliary vector passed to _start */
+void libsys_init(char* envp[], uint32_t* auxv) {
+    environ = envp;
+    aux_vector = auxv;
+}
+
+/* Look up an auxiliary vector entry */
+uint32_t getauxval(uint32_t type) {
+    if (!aux_vector) return 0;
+    
+    for (uint32_t* aux = aux_vector; aux[0] != AT_NULL; aux += 2) {
+        if (aux[0] == type) return aux[1];
+    }
+    return 0;
+}
+
+/* Look up an environment variable */
+char* getenv(const char* name) {
+    if (!environ || !name) return NULL;
+    
+    size_t len = strlen(name);
+    for (char** env = environ; *env; env++) {
+        if (strncmp(*env, name, len) == 0 && (*env)[len] == '=') {
+            return *env + len + 1;
+        }
+    }
+    return NULL;
+}
+
 /* Process API */
 void sys_exit(int code) {
     syscall1(SYS_EXIT, code);
@@ -38,13 +71,68 @@ int sys_fork(void) {
 }
 
 int sys_exec(const char* path, char* const argv[]) {
-    return syscall2(SYS_EXEC, (uint32_t)path, (uint32_t)argv);
+    return syscall3(SYS_EXEC, (uint32_t)path, (uint32_t)argv, (uint32_t)environ);
+}
+
+/* Start a program as a new child with our environment */
+int sys_spawn(const char* path, char* const argv[]) {
+    return syscall3(SYS_SPAWN, (uint32_t)path, (uint32_t)argv, (uint32_t)environ);
 }
 
 int sys_wait(int* status) {
     return syscall1(SYS_WAIT, (uint32_t)status);
 }
 
+/* First code a new thread runs, called with fn and arg on its stack */
+static void thread_start(int (*fn)(void*), void* arg) {
+    thread_exit(fn(arg));
+}
+
+/* Start fn(arg) in a new thread on a stack of its own */
+int thread_create(thread_t* thread, int (*fn)(void*), void* arg, void* tls) {
+    if (!thread || !fn) return -1;
+    
+    void* stack = sys_mmap(NULL, THREAD_STACK_SIZE, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (stack == MAP_FAILED) return -1;
+    
+    /* A frame as if thread_start had been called: return address, fn,
+     * arg, with the arguments 16-byte aligned */
+    uint32_t* sp = (uint32_t*)((uint8_t*)stack + THREAD_STACK_SIZE) - 5;
+    sp[0] = 0;
+    sp[1] = (uint32_t)fn;
+    sp[2] = (uint32_t)arg;
+    
+    int tid = syscall3(SYS_THREAD_CREATE, (uint32_t)thread_start, (uint32_t)sp, (uint32_t)tls);
+    if (tid < 0) {
+        sys_munmap(stack, THREAD_STACK_SIZE);
+        return -1;
+    }
+    
+    thread->tid = tid;
+    thread->stack = stack;
+    return 0;
+}
+
+/* Wait for a thread to finish and free its stack */
+int thread_join(thread_t* thread, int* code) {
+    if (!thread) return -1;
+    
+    if (syscall2(SYS_THREAD_JOIN, (uint32_t)thread->tid, (uint32_t)code) < 0) return -1;
+    sys_munmap(thread->stack, THREAD_STACK_SIZE);
+    thread->stack = NULL;
+    return 0;
+}
+
+void thread_exit(int code) {
+    syscall1(SYS_THREAD_EXIT, code);
+    while(1); /* Should never reach here */
+}
+
+int sys_set_tls(void* base) {
+    return syscall1(SYS_SET_TLS, (uint32_t)base);
+}
+
 int sys_getpid(void) {
     return syscall0(SYS_GETPID);
 }
@@ -59,6 +147,11 @@ int sys_getprocs(proc_info_t* procs, int max_count) {
     return syscall2(SYS_GETPROCS, (uint32_t)procs, max_count);
 }
 
+/* Limit own address space (0 = unlimited) */
+int sys_memlimit(size_t bytes) {
+    return syscall1(SYS_MEMLIMIT, bytes);
+}
+
 /* File I/O API */
 int sys_open(const char* path, int flags) {
     return syscall2(SYS_OPEN, (uint32_t)path, flags);
@@ -109,13 +202,77 @@ int sys_chdir(const char* path) {
     return syscall1(SYS_CHDIR, (uint32_t)path);
 }
 
-/* Memory API */
+/* Memory API (the allocator itself is in malloc.c) */
+void* sys_brk(void* addr) {
+    return (void*)syscall1(SYS_BRK, (uint32_t)addr);
+}
+
+void* sys_sbrk(int increment) {
+    static uint32_t cur = 0;
+    
+    if (!cur) {
+        cur = (uint32_t)sys_brk(NULL);
+    }
+    
+    uint32_t old = cur;
+    if (increment == 0) return (void*)old;
+    
+    uint32_t want = old + increment;
+    if ((increment > 0 && want < old) || (increment < 0 && want > old)) {
+        return (void*)-1;
+    }
+    
+    cur = (uint32_t)sys_brk((void*)want);
+    if (cur != want) return (void*)-1;
+    
+    return (void*)old;
+}
+
+void* sys_mmap(void* addr, size_t length, int prot, int flags, int fd, uint32_t offset) {
+    /* Too many arguments for registers: pass them in memory */
+    struct {
+        uint32_t addr;
+        uint32_t length;
+        uint32_t prot;
+        uint32_t flags;
+        int fd;
+        uint32_t offset;
+    } args = { (uint32_t)addr, length, prot, flags, fd, offset };
+    
+    return (void*)syscall1(SYS_MMAP, (uint32_t)&args);
+}
+
+int sys_munmap(void* addr, size_t length) {
+    return syscall2(SYS_MUNMAP, (uint32_t)addr, length);
+}
+
+int sys_mprotect(void* addr, size_t length, int prot) {
+    return syscall3(SYS_MPROTECT, (uint32_t)addr, length, prot);
+}
+
 void* sys_malloc(size_t size) {
-    return (void*)syscall1(SYS_MALLOC, size);
+    return malloc(size);
 }
 
 void sys_free(void* ptr) {
-    syscall1(SYS_FREE, (uint32_t)ptr);
+    free(ptr);
+}
+
+/* Shared memory API */
+int sys_shm_create(const char* name, size_t size) {
+    return syscall2(SYS_SHM_CREATE, (uint32_t)name, size);
+}
+
+void* sys_shm_attach(int id) {
+    return (void*)syscall1(SYS_SHM_ATTACH, id);
+}
+
+int sys_shm_detach(void* addr) {
+    return syscall1(SYS_SHM_DETACH, (uint32_t)addr);
+}
+
+int sys_shm_unlink(const char* name) {
+    return syscall1(SYS_SHM_UNLINK, (uint32_t)name);
 }
 
 /* Time API */
@@ -22,8 +22,8 @@
 #define SYS_FORK        8
 #define SYS_EXEC        9
 #define SYS_WAIT        10
-#define SYS_MALLOC      11
-#define SYS_FREE        12
+#define SYS_MALLOC      11  /* Retired: malloc lives in libsys */
+#define SYS_FREE        12  /* Retired */
 #define SYS_GETTIME     13
 #define SYS_SLEEP       14
 #define SYS_READDIR     15
@@ -38,6 +38,20 @@
 #define SYS_CHDIR       24
 #define SYS_KILL        25  /* NEW */
 #define SYS_GETPROCS    26  /* NEW */
+#define SYS_BRK         27
+#define SYS_MMAP        28
+#define SYS_MUNMAP      29
+#define SYS_MPROTECT    30
+#define SYS_SHM_CREATE  31
+#define SYS_SHM_ATTACH  32
+#define SYS_SHM_DETACH  33
+#define SYS_SHM_UNLINK  34
+#define SYS_MEMLIMIT    35
+#define SYS_SPAWN       36
+#define SYS_THREAD_CREATE 37
+#define SYS_THREAD_EXIT 38
+#define SYS_THREAD_JOIN 39
+#define SYS_SET_TLS     40
 
 /* File open flags */
 #define O_RDONLY    0x0001
@@ -58,6 +72,38 @@
 #define S_IFCHR     0x2000
 #define S_IFBLK     0x6000
 
+/* mmap protection */
+#define PROT_NONE   0x0
+#define PROT_READ   0x1
+#define PROT_WRITE  0x2
+#define PROT_EXEC   0x4
+
+/* mmap flags */
+#define MAP_SHARED      0x01
+#define MAP_PRIVATE     0x02
+#define MAP_FIXED       0x10
+#define MAP_ANONYMOUS   0x20
+#define MAP_FAILED      ((void*)-1)
+
+/* Auxiliary vector entry types (see getauxval) */
+#define AT_NULL         0
+#define AT_PHDR         3               /* Program headers in memory */
+#define AT_PHENT        4               /* Size of one program header */
+#define AT_PHNUM        5               /* Number of program headers */
+#define AT_PAGESZ       6               /* Page size */
+#define AT_ENTRY        9               /* Entry point */
+#define AT_CLKTCK       17              /* Timer ticks per second */
+
+/* Threads share the address space and descriptors of their process and
+ * are scheduled on their own. malloc and the console helpers take no
+ * locks, so only one thread at a time may use them. */
+#define THREAD_STACK_SIZE 65536
+
+typedef struct {
+    int tid;
+    void* stack;                        /* Freed by thread_join */
+} thread_t;
+
 /* Standard file descriptors */
 #define STDIN       0
 #define STDOUT      1
@@ -100,18 +146,28 @@ typedef struct {
     uint32_t ppid;
     uint32_t state;
     char name[64];
-    uint32_t memory_used;
+    uint32_t memory_used;               /* Resident bytes */
     uint32_t cpu_time;
+    uint32_t memory_peak;               /* Highest resident bytes */
+    uint32_t memory_virtual;            /* Bytes mapped */
+    uint32_t memory_limit;              /* Cap on mapped bytes, 0 if none */
 } proc_info_t;
 
 /* Process API */
 void sys_exit(int code);
 int sys_fork(void);
-int sys_exec(const char* path, char* const argv[]);
+int sys_exec(const char* path, char* const argv[]);    /* Passes on environ */
+int sys_spawn(const char* path, char* const argv[]);     /* Child PID; passes on environ */
 int sys_wait(int* status);
+int thread_create(thread_t* thread, int (*fn)(void*), void* arg,
+                  void* tls);           /* tls: %gs base, may be NULL */
+int thread_join(thread_t* thread, int* code);
+void thread_exit(int code);             /* Exits the process in the main thread */
+int sys_set_tls(void* base);            /* Base of the %gs segment */
 int sys_getpid(void);
 int sys_kill(int pid, int signal);  /* NEW */
 int sys_getprocs(proc_info_t* procs, int max_count);  /* NEW */
+int sys_memlimit(size_t bytes);         /* Cap own mapped memory, returns old cap */
 
 /* File I/O API */
 int sys_open(const char* path, int flags);
@@ -130,8 +186,24 @@ int sys_getcwd(char* buf, size_t size);
 int sys_chdir(const char* path);
 
 /* Memory API */
-void* sys_malloc(size_t size);
-void sys_free(void* ptr);
+void* sys_brk(void* addr);              /* Set program break, returns new break */
+void* sys_sbrk(int increment);          /* Grow/shrink heap, returns old break */
+void* malloc(size_t size);
+void free(void* ptr);
+void* calloc(size_t count, size_t size);
+void* realloc(void* ptr, size_t size);
+void* sys_mmap(void* addr, size_t length, int prot, int flags, int fd, uint32_t offset);
+int sys_munmap(void* addr, size_t length);
+int sys_mprotect(void* addr, size_t length, int prot);
+void* sys_malloc(size_t size);          /* Same as malloc */
+void sys_free(void* ptr);               /* Same as free */
+
+/* Shared memory API: segments are named, zero-filled and mapped
+ * read/write; every attachment sees the same physical pages */
+int sys_shm_create(const char* name, size_t size);   /* Open or create, returns id */
+void* sys_shm_attach(int id);                        /* MAP_FAILED on error */
+int sys_shm_detach(void* addr);
+int sys_shm_unlink(const char* name);                /* Freed after last detach */
 
 /* Time API */
 int sys_gettime(time_t* t);
@@ -145,6 +217,12 @@ int sys_umount(const char* target);
 int sys_load_driver(const char* path);
 int sys_ioctl(int fd, uint32_t request, void* arg);
 
+/* Startup data; _start hands the kernel's envp and auxv to libsys_init */
+extern char** environ;
+void libsys_init(char* envp[], uint32_t* auxv);
+uint32_t getauxval(uint32_t type);      /* 0 if the kernel did not pass it */
+char* getenv(const char* name);
+
 /* Console I/O helpers */
 void print(const char* str);
 void println(const char* str);
@@ -0,0 +1,263 @@
+/* malloc.c - Userspace heap allocator
+ *
+ * The heap lives between the end of the program image and the program
+ * break, which is moved with sys_sbrk(); the kernel zero-fills the pages
+ * on first touch. Requests up to MALLOC_SMALL_MAX bytes are served from
+ * power-of-two size-class bins, refilled a span at a time, so the common
+ * malloc/free pair is a list push/pop with no system call. Larger
+ * requests come from an address-ordered free list with first-fit
+ * allocation and coalescing; a large free block at the top of the heap is
+ * handed back to the kernel once it exceeds MALLOC_TRIM.
+ */
+
+#include "libsys.h"
+
+#define MALLOC_MAGIC_SMALL  0x5A11C0DE
+#define MALLOC_MAGIC_LARGE  0x1A26EC0D
+#define MALLOC_MAGIC_FREE   0xF2EEC0DE
+
+#define MALLOC_MIN_SHIFT    4           /* Smallest class: 16 bytes */
+#define MALLOC_BINS         8           /* Classes 16 .. 2048 bytes */
+#define MALLOC_SMALL_MAX    ((1 << (MALLOC_MIN_SHIFT + MALLOC_BINS - 1)) - sizeof(chunk_t))
+#define MALLOC_SPAN         16384       /* Bytes carved into a bin per refill */
+#define MALLOC_GROW_MIN     65536       /* Smallest heap extension */
+#define MALLOC_TRIM         131072      /* Free top of heap kept before trimming */
+#define MALLOC_PAGE         4096
+
+/* Header in front of every chunk (keeps payloads 8-byte aligned) */
+typedef struct {
+    uint32_t size;                      /* Chunk size including header */
+    uint32_t magic;
+} chunk_t;
+
+/* Free chunks reuse the payload for links */
+typedef struct free_chunk {
+    chunk_t hdr;
+    struct free_chunk* next;
+} free_chunk_t;
+
+#define MALLOC_MIN_LARGE    16          /* sizeof(free_chunk_t), rounded */
+
+static free_chunk_t* bins[MALLOC_BINS];
+static free_chunk_t* large_free = NULL; /* Sorted by address */
+static uint32_t heap_top = 0;           /* Current program break */
+
+/* Round up to a multiple of align (power of two) */
+static uint32_t align_up(uint32_t value, uint32_t align) {
+    return (value + align - 1) & ~(align - 1);
+}
+
+/* Bin index for a request, -1 if it is large */
+static int size_to_bin(size_t size) {
+    if (size > MALLOC_SMALL_MAX) return -1;
+
+    uint32_t total = size + sizeof(chunk_t);
+    int bin = 0;
+    while ((1u << (MALLOC_MIN_SHIFT + bin)) < total) {
+        bin++;
+    }
+    return bin;
+}
+
+/* Put a free large chunk back, merging it with adjacent free chunks */
+static void large_insert(free_chunk_t* chunk) {
+    free_chunk_t* prev = NULL;
+    free_chunk_t* next = large_free;
+    while (next && next < chunk) {
+        prev = next;
+        next = next->next;
+    }
+
+    chunk->hdr.magic = MALLOC_MAGIC_FREE;
+
+    if (next && (uint8_t*)chunk + chunk->hdr.size == (uint8_t*)next) {
+        chunk->hdr.size += next->hdr.size;
+        next = next->next;
+    }
+    chunk->next = next;
+
+    if (prev && (uint8_t*)prev + prev->hdr.size == (uint8_t*)chunk) {
+        prev->hdr.size += chunk->hdr.size;
+        prev->next = next;
+    } else if (prev) {
+        prev->next = chunk;
+    } else {
+        large_free = chunk;
+    }
+}
+
+/* Extend the heap by at least size bytes */
+static int heap_grow(uint32_t size) {
+    if (!heap_top) {
+        heap_top = (uint32_t)sys_sbrk(0);
+    }
+
+    uint32_t grow = size > MALLOC_GROW_MIN ? size : MALLOC_GROW_MIN;
+    grow = align_up(grow, MALLOC_PAGE);
+
+    void* old = sys_sbrk(grow);
+    if (old == (void*)-1) return -1;
+
+    free_chunk_t* chunk = (free_chunk_t*)old;
+    chunk->hdr.size = grow;
+    heap_top = (uint32_t)old + grow;
+    large_insert(chunk);
+
+    return 0;
+}
+
+/* Give a large free chunk at the top of the heap back to the kernel */
+static void heap_trim(void) {
+    free_chunk_t* prev = NULL;
+    free_chunk_t* last = large_free;
+    if (!last) return;
+    while (last->next) {
+        prev = last;
+        last = last->next;
+    }
+
+    uint32_t start = (uint32_t)last;
+    if (start + last->hdr.size != heap_top || last->hdr.size < MALLOC_TRIM) return;
+
+    /* Keep the part of the chunk below the first whole page */
+    uint32_t cut = align_up(start + MALLOC_MIN_LARGE, MALLOC_PAGE);
+    if (cut >= heap_top) return;
+
+    if (sys_sbrk(-(int)(heap_top - cut)) == (void*)-1) return;
+    heap_top = cut;
+
+    if (cut - start >= MALLOC_MIN_LARGE) {
+        last->hdr.size = cut - start;
+    } else if (prev) {
+        prev->next = NULL;
+    } else {
+        large_free = NULL;
+    }
+}
+
+/* First-fit allocation of a whole chunk from the large free list */
+static chunk_t* large_alloc(uint32_t total) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        free_chunk_t** link = &large_free;
+        while (*link) {
+            free_chunk_t* chunk = *link;
+            if (chunk->hdr.size >= total) {
+                uint32_t rest = chunk->hdr.size - total;
+                if (rest >= MALLOC_MIN_LARGE) {
+                    /* Split, the tail stays on the list in place */
+                    free_chunk_t* tail = (free_chunk_t*)((uint8_t*)chunk + total);
+                    tail->hdr.size = rest;
+                    tail->hdr.magic = MALLOC_MAGIC_FREE;
+                    tail->next = chunk->next;
+                    *link = tail;
+                    chunk->hdr.size = total;
+                } else {
+                    *link = chunk->next;
+                }
+
+                chunk->hdr.magic = MALLOC_MAGIC_LARGE;
+                return &chunk->hdr;
+            }
+            link = &chunk->next;
+        }
+
+        if (attempt == 0 && heap_grow(total) < 0) break;
+    }
+
+    return NULL;
+}
+
+/* Carve a span into chunks of one size class */
+static int bin_refill(int bin) {
+    chunk_t* span = large_alloc(MALLOC_SPAN);
+    if (!span) return -1;
+
+    uint32_t size = 1u << (MALLOC_MIN_SHIFT + bin);
+    uint8_t* p = (uint8_t*)(span + 1);
+    uint8_t* end = (uint8_t*)span + span->size;
+
+    /* Spans stay with their bin for good */
+    while (p + size <= end) {
+        free_chunk_t* chunk = (free_chunk_t*)p;
+        chunk->hdr.size = size;
+        chunk->hdr.magic = MALLOC_MAGIC_FREE;
+        chunk->next = bins[bin];
+        bins[bin] = chunk;
+        p += size;
+    }
+
+    return 0;
+}
+
+/* Allocate memory */
+void* malloc(size_t size) {
+    if (size == 0) size = 1;
+
+    int bin = size_to_bin(size);
+    if (bin >= 0) {
+        if (!bins[bin] && bin_refill(bin) < 0) return NULL;
+
+        free_chunk_t* chunk = bins[bin];
+        bins[bin] = chunk->next;
+        chunk->hdr.magic = MALLOC_MAGIC_SMALL;
+        return &chunk->next;
+    }
+
+    if (size > 0x7FFFFFFF - MALLOC_PAGE) return NULL;
+
+    uint32_t total = align_up(size + sizeof(chunk_t), 8);
+    chunk_t* chunk = large_alloc(total);
+    return chunk ? chunk + 1 : NULL;
+}
+
+/* Free memory */
+void free(void* ptr) {
+    if (!ptr) return;
+
+    chunk_t* hdr = (chunk_t*)ptr - 1;
+
+    if (hdr->magic == MALLOC_MAGIC_SMALL) {
+        int bin = size_to_bin(hdr->size - sizeof(chunk_t));
+        free_chunk_t* chunk = (free_chunk_t*)hdr;
+        chunk->hdr.magic = MALLOC_MAGIC_FREE;
+        chunk->next = bins[bin];
+        bins[bin] = chunk;
+    } else if (hdr->magic == MALLOC_MAGIC_LARGE) {
+        large_insert((free_chunk_t*)hdr);
+        heap_trim();
+    }
+    /* Anything else is a double free or a stray pointer: ignore it */
+}
+
+/* Allocate zeroed memory */
+void* calloc(size_t count, size_t size) {
+    if (size && count > 0xFFFFFFFF / size) return NULL;
+
+    void* ptr = malloc(count * size);
+    if (ptr) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+/* Resize an allocation */
+void* realloc(void* ptr, size_t size) {
+    if (!ptr) return malloc(size);
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+
+    chunk_t* hdr = (chunk_t*)ptr - 1;
+    if (hdr->magic != MALLOC_MAGIC_SMALL && hdr->magic != MALLOC_MAGIC_LARGE) return NULL;
+
+    size_t usable = hdr->size - sizeof(chunk_t);
+    if (size <= usable) return ptr;
+
+    void* copy = malloc(size);
+    if (!copy) return NULL;
+
+    memcpy(copy, ptr, usable);
+    free(ptr);
+    return copy;
+}
@@ -13,16 +13,20 @@ extern char bss_end[];
 /* Main function prototype */
 extern int main(int argc, char* argv[]);
 
-/* Application entry point */
-void _start(int argc, char* argv[]) __attribute__((section(".text.start")));
+/* Application entry point: the kernel lays out the stack as for a call
+ * to _start(argc, argv, envp, auxv) */
+void _start(int argc, char* argv[], char* envp[], uint32_t* auxv) __attribute__((section(".text.start")));
 
-void _start(int argc, char* argv[]) {
+void _start(int argc, char* argv[], char* envp[], uint32_t* auxv) {
     /* Clear BSS section */
     char* bss = bss_start;
     while (bss < bss_end) {
         *bss++ = 0;
     }
     
+    /* Environment and auxiliary vector for libsys */
+    libsys_init(envp, auxv);
+    
     /* Call main */
     int exit_code = main(argc, argv);
     
@@ -66,29 +66,42 @@ static int load_file(const char* filename) {
     }
     
     editor.line_count = 0;
-    char buffer[4096];
-    int bytes_read = sys_read(fd, buffer, sizeof(buffer) - 1);
-    sys_close(fd);
     
-    if (bytes_read < 0) {
+    /* Map the file instead of staging it through a fixed buffer */
+    stat_t st;
+    if (sys_stat(filename, &st) < 0) {
+        sys_close(fd);
         println("Error reading file");
         return -1;
     }
     
-    buffer[bytes_read] = '\0';
+    const char* data = NULL;
+    if (st.st_size > 0) {
+        data = (const char*)sys_mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    sys_close(fd);
+    
+    if (data == MAP_FAILED) {
+        println("Error reading file");
+        return -1;
+    }
     
     /* Parse lines */
     int line_pos = 0;
-    for (int i = 0; i < bytes_read && editor.line_count < MAX_LINES; i++) {
-        if (buffer[i] == '\n' || buffer[i] == '\0') {
+    for (uint32_t i = 0; i < st.st_size && editor.line_count < MAX_LINES; i++) {
+        if (data[i] == '\n' || data[i] == '\0') {
             editor.lines[editor.line_count][line_pos] = '\0';
             editor.line_count++;
             line_pos = 0;
         } else if (line_pos < MAX_LINE_LEN - 1) {
-            editor.lines[editor.line_count][line_pos++] = buffer[i];
+            editor.lines[editor.line_count][line_pos++] = data[i];
         }
     }
     
+    if (data) {
+        sys_munmap((void*)data, st.st_size);
+    }
+    
     /* Handle last line */
     if (line_pos > 0 && editor.line_count < MAX_LINES) {
         editor.lines[editor.line_count][line_pos] = '\0';
@@ -42,8 +42,8 @@ static void display_processes(void) {
     }
     
     println("Running Processes:");
-    println("  PID  PPID  STATE     CPU TIME  NAME");
-    println("  ---- ----  --------  --------  --------------------");
+    println("  PID  PPID  STATE     RSS KB  PEAK KB  VIRT KB  CPU TIME  NAME");
+    println("  ---- ----  --------  ------  -------  -------  --------  --------------------");
     
     for (int i = 0; i < count; i++) {
         const char* state_str;
@@ -56,12 +56,16 @@ static void display_processes(void) {
             default:                 state_str = "UNKNOWN "; break;
         }
         
-        printf("  %-4u %-4u  %s  %-8u  %s\n", 
+        printf("  %-4u %-4u  %s  %-6u  %-7u  %-7u  %-8u  %s%s\n", 
                procs[i].pid, 
                procs[i].ppid,
                state_str,
+               procs[i].memory_used / 1024,
+               procs[i].memory_peak / 1024,
+               procs[i].memory_virtual / 1024,
                procs[i].cpu_time,
-               procs[i].name);
+               procs[i].name,
+               procs[i].memory_limit ? " (limited)" : "");
     }
     
     printf("\nTotal: %d processes\n", count);
@@ -28,27 +28,17 @@ static void snprintf(char* str, size_t size, const char* format, ...) {
 
 /* Execute external program */
 static int execute_program(char* argv[]) {
-    int pid = sys_fork();
+    int pid = sys_spawn(argv[0], argv);
     
     if (pid < 0) {
-        println("Error: Failed to fork");
+        printf("Error: Failed to execute: %s\n", argv[0]);
         return -1;
-    } else if (pid == 0) {
-        /* Child process */
-        if (sys_exec(argv[0], argv) < 0) {
-            printf("Error: Failed to execute: %s\n", argv[0]);
-            sys_exit(1);
-        }
-        /* Should never reach here */
-        sys_exit(0);
-    } else {
-        /* Parent process - wait for child */
-        int status;
-        sys_wait(&status);
-        return status;
     }
     
-    return 0;
+    /* Wait for child */
+    int status;
+    sys_wait(&status);
+    return status;
 }
 
 /* Built-in: cd */
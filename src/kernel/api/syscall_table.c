@@ -19,8 +19,6 @@ syscall_fn_t syscall_table[] = {
     [SYS_FORK]        = (syscall_fn_t)sys_fork,
     [SYS_EXEC]        = (syscall_fn_t)sys_exec,
     [SYS_WAIT]        = (syscall_fn_t)sys_wait,
-    [SYS_MALLOC]      = (syscall_fn_t)sys_malloc,
-    [SYS_FREE]        = (syscall_fn_t)sys_free,
     [SYS_GETTIME]     = (syscall_fn_t)sys_gettime,
     [SYS_SLEEP]       = (syscall_fn_t)sys_sleep,
     [SYS_READDIR]     = (syscall_fn_t)sys_readdir,
@@ -35,6 +33,20 @@ syscall_fn_t syscall_table[] = {
     [SYS_CHDIR]       = (syscall_fn_t)sys_chdir,
     [SYS_KILL]        = (syscall_fn_t)sys_kill,       /* NEW */
     [SYS_GETPROCS]    = (syscall_fn_t)sys_getprocs,   /* NEW */
+    [SYS_BRK]         = (syscall_fn_t)sys_brk,
+    [SYS_MMAP]        = (syscall_fn_t)sys_mmap,
+    [SYS_MUNMAP]      = (syscall_fn_t)sys_munmap,
+    [SYS_MPROTECT]    = (syscall_fn_t)sys_mprotect,
+    [SYS_SHM_CREATE]  = (syscall_fn_t)sys_shm_create,
+    [SYS_SHM_ATTACH]  = (syscall_fn_t)sys_shm_attach,
+    [SYS_SHM_DETACH]  = (syscall_fn_t)sys_shm_detach,
+    [SYS_SHM_UNLINK]  = (syscall_fn_t)sys_shm_unlink,
+    [SYS_MEMLIMIT]    = (syscall_fn_t)sys_memlimit,
+    [SYS_SPAWN]       = (syscall_fn_t)sys_spawn,
+    [SYS_THREAD_CREATE] = (syscall_fn_t)sys_thread_create,
+    [SYS_THREAD_EXIT] = (syscall_fn_t)sys_thread_exit,
+    [SYS_THREAD_JOIN] = (syscall_fn_t)sys_thread_join,
+    [SYS_SET_TLS]     = (syscall_fn_t)sys_set_tls,
 };
 
 /* Number of system calls */
@@ -2,8 +2,10 @@
 
 #include "syscalls.h"
 #include "../proc/process.h"
-#include "../mm/heap.h"
 #include "../fs/vfs.h"
+#include "../mm/shm.h"
+#include "../mm/zpool.h"
+#include "../mm/vmm.h"
 #include "../drivers/driver.h"
 #include "../core/timer.h"
 #include "../core/console.h"
@@ -35,12 +37,11 @@ static void* memcpy(void* dest, const void* src, size_t n) {
     return dest;
 }
 
-/* Exit current process */
+/* Exit current process, all of its threads */
 int sys_exit(int code) {
     process_t* current = process_get_current();
     if (current) {
-        current->exit_code = code;
-        process_exit(current);
+        process_exit_group(current, code);
     }
     return 0;
 }
@@ -62,9 +63,8 @@ int sys_write(int fd, const void* buf, size_t count) {
 int sys_read(int fd, void* buf, size_t count) {
     if (fd == 0) { /* STDIN */
         /* Use keyboard for input */
-        extern void keyboard_read_line(char* buffer, size_t max_len);
-        keyboard_read_line((char*)buf, count);
-        return strlen((char*)buf);
+        extern int keyboard_read_line(char* buffer, size_t max_len);
+        return keyboard_read_line((char*)buf, count);
     }
     
     return vfs_read(fd, buf, count);
@@ -108,11 +108,22 @@ int sys_fork(void) {
 }
 
 /* Execute program */
-int sys_exec(const char* path, char* const argv[]) {
+int sys_exec(const char* path, char* const argv[], char* const envp[]) {
     process_t* current = process_get_current();
     if (!current) return -1;
     
-    return process_exec(current, path, argv);
+    return process_exec(current, path, argv, envp);
+}
+
+/* Start a program in a new child without copying our address space */
+int sys_spawn(const char* path, char* const argv[], char* const envp[]) {
+    process_t* current = process_get_current();
+    if (!current || !path) return -1;
+    
+    process_t* child = process_spawn(current, path, argv, envp);
+    if (!child) return -1;
+    
+    return child->pid;
 }
 
 /* Wait for child process */
@@ -123,6 +134,40 @@ int sys_wait(int* status) {
     return process_wait(current, status);
 }
 
+/* Start a thread in the caller's process */
+int sys_thread_create(uint32_t entry, uint32_t stack, uint32_t tls) {
+    process_t* thread = process_thread_create(process_get_current(), entry, stack, tls);
+    return thread ? (int)thread->pid : -1;
+}
+
+/* End the calling thread (the whole process if it is the leader) */
+int sys_thread_exit(int code) {
+    process_t* current = process_get_current();
+    if (!current) return -1;
+    
+    if (!current->group_leader) {
+        return sys_exit(code);
+    }
+    current->exit_code = code;
+    process_exit(current);
+    return 0;
+}
+
+/* Wait for a thread of the caller's process */
+int sys_thread_join(int tid, int* status) {
+    if (tid < 0) return -1;
+    return process_thread_join(process_get_current(), (uint32_t)tid, status);
+}
+
+/* Set the caller's TLS segment base */
+int sys_set_tls(uint32_t base) {
+    process_t* current = process_get_current();
+    if (!current) return -1;
+    
+    process_set_tls(current, base);
+    return 0;
+}
+
 /* Kill process - NEW */
 int sys_kill(int pid, int signal) {
     /* Don't allow killing kernel process */
@@ -154,41 +199,97 @@ int sys_getprocs(void* procs_buf, int max_count) {
         char name[64];
         uint32_t memory_used;
         uint32_t cpu_time;
+        uint32_t memory_peak;
+        uint32_t memory_virtual;
+        uint32_t memory_limit;
     } proc_info_t;
     
     proc_info_t* procs = (proc_info_t*)procs_buf;
     int count = 0;
     
-    /* Iterate through process list */
-    extern process_t* process_list;  /* Need to expose this */
-    
-    /* For now, use process_get_by_pid to iterate */
-    for (int pid = 0; pid < 256 && count < max_count; pid++) {
-        process_t* proc = process_get_by_pid(pid);
-        if (proc) {
-            procs[count].pid = proc->pid;
-            procs[count].ppid = proc->parent_pid;
-            procs[count].state = proc->state;
-            strncpy(procs[count].name, proc->name, 63);
-            procs[count].name[63] = '\0';
-            procs[count].memory_used = 0;  /* TODO: Calculate actual memory usage */
-            procs[count].cpu_time = timer_get_ticks() - proc->start_time;
-            count++;
-        }
+    /* The process table is a packed array */
+    int total = process_count();
+    for (int i = 0; i < total && count < max_count; i++) {
+        process_t* proc = process_get_at(i);
+        procs[count].pid = proc->pid;
+        procs[count].ppid = proc->parent_pid;
+        procs[count].state = proc->state;
+        strncpy(procs[count].name, proc->name, 63);
+        procs[count].name[63] = '\0';
+        procs[count].memory_used = proc->rss_pages * PAGE_SIZE;
+        procs[count].memory_peak = proc->rss_peak * PAGE_SIZE;
+        procs[count].memory_virtual = proc->vm_pages * PAGE_SIZE;
+        procs[count].memory_limit = proc->mem_limit * PAGE_SIZE;
+        procs[count].cpu_time = timer_get_ticks() - proc->start_time;
+        count++;
     }
     
     return count;
 }
 
-/* Allocate memory */
-void* sys_malloc(size_t size) {
-    return kmalloc(size);
+/* Set program break (user heap is managed by libsys on top of this) */
+int sys_brk(uint32_t addr) {
+    return (int)process_brk(process_get_current(), addr);
 }
 
-/* Free memory */
-int sys_free(void* ptr) {
-    kfree(ptr);
-    return 0;
+/* Map memory: anonymous private memory or a read-only view of a file */
+int sys_mmap(const mmap_args_t* args) {
+    if (!args) return -1;
+    
+    uint32_t sharing = args->flags & (MAP_SHARED | MAP_PRIVATE);
+    if (sharing != MAP_SHARED && sharing != MAP_PRIVATE) return -1;
+    
+    vfs_node_t* file = NULL;
+    if (!(args->flags & MAP_ANONYMOUS)) {
+        file = vfs_get_node(args->fd);
+        if (!file || !file->read || (file->flags & VFS_DIRECTORY)) return -1;
+    }
+    
+    /* Shared memory goes through shm; shared file views must be read-only */
+    if (sharing == MAP_SHARED && (!file || (args->prot & PROT_WRITE))) return -1;
+    
+    /* PROT_* bits double as REGION_* flags */
+    uint32_t addr = process_mmap(process_get_current(), args->addr, args->length,
+                                 args->prot & (PROT_READ | PROT_WRITE | PROT_EXEC),
+                                 (args->flags & MAP_FIXED) != 0, file, args->offset);
+    return addr ? (int)addr : -1;
+}
+
+/* Unmap memory */
+int sys_munmap(uint32_t addr, uint32_t length) {
+    return process_munmap(process_get_current(), addr, length);
+}
+
+/* Change memory protection */
+int sys_mprotect(uint32_t addr, uint32_t length, uint32_t prot) {
+    return process_mprotect(process_get_current(), addr, length,
+                            prot & (PROT_READ | PROT_WRITE | PROT_EXEC));
+}
+
+/* Open or create a named shared memory segment */
+int sys_shm_create(const char* name, uint32_t size) {
+    return shm_create(name, size);
+}
+
+/* Map a shared memory segment */
+int sys_shm_attach(int id) {
+    uint32_t addr = process_shm_attach(process_get_current(), id);
+    return addr ? (int)addr : -1;
+}
+
+/* Unmap a shared memory segment */
+int sys_shm_detach(uint32_t addr) {
+    return process_shm_detach(process_get_current(), addr);
+}
+
+/* Remove a shared memory segment name */
+int sys_shm_unlink(const char* name) {
+    return shm_unlink(name);
+}
+
+/* Cap the caller's address space (0 removes the cap) */
+int sys_memlimit(uint32_t bytes) {
+    return (int)process_set_mem_limit(process_get_current(), bytes);
 }
 
 /* Get current time */
@@ -213,13 +314,7 @@ int sys_gettime(void* timebuf) {
 
 /* Sleep for milliseconds */
 int sys_sleep(uint32_t ms) {
-    uint32_t start = timer_get_uptime_ms();
-    uint32_t end = start + ms;
-    
-    while (timer_get_uptime_ms() < end) {
-        __asm__ volatile("hlt");
-    }
-    
+    timer_sleep(ms);
     return 0;
 }
 
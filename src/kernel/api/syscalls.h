@@ -18,8 +18,8 @@
 #define SYS_FORK        8
 #define SYS_EXEC        9
 #define SYS_WAIT        10
-#define SYS_MALLOC      11
-#define SYS_FREE        12
+#define SYS_MALLOC      11  /* Retired: malloc lives in libsys */
+#define SYS_FREE        12  /* Retired */
 #define SYS_GETTIME     13
 #define SYS_SLEEP       14
 #define SYS_READDIR     15
@@ -34,6 +34,40 @@
 #define SYS_CHDIR       24
 #define SYS_KILL        25  /* NEW */
 #define SYS_GETPROCS    26  /* NEW */
+#define SYS_BRK         27
+#define SYS_MMAP        28
+#define SYS_MUNMAP      29
+#define SYS_MPROTECT    30
+#define SYS_SHM_CREATE  31
+#define SYS_SHM_ATTACH  32
+#define SYS_SHM_DETACH  33
+#define SYS_SHM_UNLINK  34
+#define SYS_MEMLIMIT    35
+#define SYS_SPAWN       36
+#define SYS_THREAD_CREATE 37
+#define SYS_THREAD_EXIT 38
+#define SYS_THREAD_JOIN 39
+#define SYS_SET_TLS     40
+
+/* mmap protection and flags (must match libsys.h) */
+#define PROT_NONE       0x0
+#define PROT_READ       0x1
+#define PROT_WRITE      0x2
+#define PROT_EXEC       0x4
+#define MAP_SHARED      0x01
+#define MAP_PRIVATE     0x02
+#define MAP_FIXED       0x10
+#define MAP_ANONYMOUS   0x20
+
+/* SYS_MMAP takes more arguments than fit in registers */
+typedef struct {
+    uint32_t addr;
+    uint32_t length;
+    uint32_t prot;
+    uint32_t flags;
+    int fd;
+    uint32_t offset;
+} mmap_args_t;
 
 /* System call implementations */
 int sys_exit(int code);
@@ -45,10 +79,13 @@ int sys_seek(int fd, int offset, int whence);
 int sys_stat(const char* path, void* statbuf);
 int sys_getpid(void);
 int sys_fork(void);
-int sys_exec(const char* path, char* const argv[]);
+int sys_exec(const char* path, char* const argv[], char* const envp[]);
+int sys_spawn(const char* path, char* const argv[], char* const envp[]);
 int sys_wait(int* status);
-void* sys_malloc(size_t size);
-int sys_free(void* ptr);
+int sys_thread_create(uint32_t entry, uint32_t stack, uint32_t tls);
+int sys_thread_exit(int code);
+int sys_thread_join(int tid, int* status);
+int sys_set_tls(uint32_t base);
 int sys_gettime(void* timebuf);
 int sys_sleep(uint32_t ms);
 int sys_readdir(int fd, void* entry);
@@ -63,5 +100,14 @@ int sys_getcwd(char* buf, size_t size);
 int sys_chdir(const char* path);
 int sys_kill(int pid, int signal);         /* NEW */
 int sys_getprocs(void* procs, int max_count);  /* NEW */
+int sys_brk(uint32_t addr);
+int sys_mmap(const mmap_args_t* args);
+int sys_munmap(uint32_t addr, uint32_t length);
+int sys_mprotect(uint32_t addr, uint32_t length, uint32_t prot);
+int sys_shm_create(const char* name, uint32_t size);
+int sys_shm_attach(int id);
+int sys_shm_detach(uint32_t addr);
+int sys_shm_unlink(const char* name);
+int sys_memlimit(uint32_t bytes);
 
 #endif /* SYSCALLS_H */
\ No newline at end of file
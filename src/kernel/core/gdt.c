@@ -1,6 +1,9 @@
 /* gdt.c - Global Descriptor Table implementation
  * 
- * Sets up a flat memory model with kernel code and data segments.
+ * Sets up a flat memory model with kernel code and data segments, plus
+ * the TSS that tells the CPU which kernel stack to use when an interrupt
+ * or system call arrives from user mode. A last user data segment has
+ * its base moved to the running thread's thread-local storage.
  */
 
 #include "gdt.h"
@@ -21,9 +24,26 @@ struct gdt_ptr {
     uint32_t base;
 } __attribute__((packed));
 
-/* GDT with 5 entries: null, kernel code, kernel data, user code, user data */
-static struct gdt_entry gdt[5];
+/* Task state segment; only ss0:esp0 is used (no hardware task switching) */
+struct tss_entry {
+    uint32_t prev_tss;
+    uint32_t esp0, ss0;
+    uint32_t esp1, ss1;
+    uint32_t esp2, ss2;
+    uint32_t cr3, eip, eflags;
+    uint32_t eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    uint32_t es, cs, ss, ds, fs, gs;
+    uint32_t ldt;
+    uint16_t trap;
+    uint16_t iomap_base;
+} __attribute__((packed));
+
+/* GDT with 7 entries: null, kernel code, kernel data, user code, user data,
+ * TSS, user TLS */
+#define GDT_ENTRIES 7
+static struct gdt_entry gdt[GDT_ENTRIES];
 static struct gdt_ptr gdt_pointer;
+static struct tss_entry tss;
 
 /* External assembly function to load GDT */
 extern void gdt_flush(uint32_t);
@@ -40,7 +60,7 @@ static void gdt_set_gate(int num, uint32_t base, uint32_t limit, uint8_t access,
 }
 
 void gdt_init(void) {
-    gdt_pointer.limit = (sizeof(struct gdt_entry) * 5) - 1;
+    gdt_pointer.limit = (sizeof(struct gdt_entry) * GDT_ENTRIES) - 1;
     gdt_pointer.base = (uint32_t)&gdt;
     
     /* Null descriptor */
@@ -58,8 +78,31 @@ void gdt_init(void) {
     /* User data segment: base=0, limit=4GB, access=0xF2, granularity=0xCF */
     gdt_set_gate(4, 0, 0xFFFFFFFF, 0xF2, 0xCF);
     
-    /* Load the new GDT */
+    /* TSS: available 32-bit TSS, byte granularity; no I/O bitmap */
+    uint8_t* t = (uint8_t*)&tss;
+    for (uint32_t i = 0; i < sizeof(tss); i++) {
+        t[i] = 0;
+    }
+    tss.ss0 = GDT_KERNEL_DATA;
+    tss.iomap_base = sizeof(tss);
+    gdt_set_gate(5, (uint32_t)&tss, sizeof(tss) - 1, 0x89, 0x00);
+    
+    /* User TLS segment: like user data, base set per thread */
+    gdt_set_gate(6, 0, 0xFFFFFFFF, 0xF2, 0xCF);
+    
+    /* Load the new GDT and the task register */
     gdt_flush((uint32_t)&gdt_pointer);
+    __asm__ volatile("ltr %w0" :: "r"(GDT_TSS));
+}
+
+/* Set the kernel stack used on entry from ring 3 */
+void tss_set_kernel_stack(uint32_t esp0) {
+    tss.esp0 = esp0;
+}
+
+/* Point the user TLS segment at a thread's storage */
+void gdt_set_tls_base(uint32_t base) {
+    gdt_set_gate(6, base, 0xFFFFFFFF, 0xF2, 0xCF);
 }
 
 /* Assembly stub to load GDT */
@@ -5,7 +5,22 @@
 
 #include <stdint.h>
 
+/* Segment selectors */
+#define GDT_KERNEL_CODE 0x08
+#define GDT_KERNEL_DATA 0x10
+#define GDT_USER_CODE   0x1B          /* RPL 3 */
+#define GDT_USER_DATA   0x23          /* RPL 3 */
+#define GDT_TSS         0x28
+#define GDT_USER_TLS    0x33          /* RPL 3, base follows the running thread */
+
 /* Initialize GDT */
 void gdt_init(void);
 
+/* Stack the CPU switches to on an interrupt from user mode */
+void tss_set_kernel_stack(uint32_t esp0);
+
+/* Base of the user TLS segment; takes effect when a selector for it is
+ * next loaded (the return to user mode pops it from the trap frame) */
+void gdt_set_tls_base(uint32_t base);
+
 #endif /* GDT_H */
\ No newline at end of file
@@ -116,20 +116,21 @@ void irq_register_handler(uint8_t irq, isr_handler_t handler) {
 
 /* Common IRQ handler */
 void irq_handler(registers_t* regs) {
-    /* Call custom handler if registered */
-    uint8_t irq = regs->int_no - 32;
-    if (irq_handlers[irq] != 0) {
-        isr_handler_t handler = irq_handlers[irq];
-        handler(regs);
-    }
-    
-    /* Send EOI to PIC */
+    /* Acknowledge first: the timer handler may switch to another process
+     * and only come back here much later. Interrupts stay off until iret. */
     if (regs->int_no >= 40) {
         /* Send EOI to slave PIC */
         outb(PIC2_COMMAND, PIC_EOI);
     }
     /* Always send EOI to master PIC */
     outb(PIC1_COMMAND, PIC_EOI);
+    
+    /* Call custom handler if registered */
+    uint8_t irq = regs->int_no - 32;
+    if (irq_handlers[irq] != 0) {
+        isr_handler_t handler = irq_handlers[irq];
+        handler(regs);
+    }
 }
 
 /* Assembly IRQ stubs */
@@ -163,6 +164,9 @@ __asm__(
     "irq_common_stub:\n"
     "   pusha\n"
     "   push %ds\n"
+    "   push %es\n"
+    "   push %fs\n"
+    "   push %gs\n"
     "   mov $0x10, %ax\n"
     "   mov %ax, %ds\n"
     "   mov %ax, %es\n"
@@ -171,8 +175,5 @@ __asm__(
     "   push %esp\n"
     "   call irq_handler\n"
     "   add $4, %esp\n"
-    "   pop %ds\n"
-    "   popa\n"
-    "   add $8, %esp\n"
-    "   iret\n"
+    "   jmp interrupt_return\n"
 );
\ No newline at end of file
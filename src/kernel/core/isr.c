@@ -3,6 +3,9 @@
 #include "isr.h"
 #include "idt.h"
 #include "console.h"
+#include "../mm/vmm.h"
+#include "../mm/region.h"
+#include "../proc/process.h"
 
 /* ISR handler array */
 static isr_handler_t isr_handlers[256];
@@ -77,6 +80,48 @@ extern void isr29(void);
 extern void isr30(void);
 extern void isr31(void);
 
+/* Page fault: resolve copy-on-write and demand paging faults */
+static void page_fault_handler(registers_t* regs) {
+    uint32_t fault_addr;
+    __asm__ volatile("mov %%cr2, %0" : "=r"(fault_addr));
+    
+    process_t* proc = process_get_current();
+    int user_addr = fault_addr >= USER_SPACE_START && fault_addr < USER_SPACE_END;
+    
+    /* Copy-on-write, unless the mapping itself is read-only (mprotect) */
+    if ((!user_addr || !proc || region_allows(process_mm(proc)->regions, fault_addr, regs->err_code)) &&
+        vmm_handle_page_fault(fault_addr, regs->err_code) == 0) {
+        return;
+    }
+    
+    /* First touch of a demand-paged user page */
+    if (proc) {
+        int mapped = region_handle_fault(process_mm(proc)->regions, fault_addr, regs->err_code);
+        if (mapped > 0) {
+            process_account_rss(proc, mapped);
+            return;
+        }
+    }
+    
+    /* A bad user access only takes down the process */
+    if (proc && proc->pid != 0 && (regs->cs & 3) == 3) {
+        kprintf("[PROC] PID %d: segmentation fault at 0x%x (EIP 0x%x)\n",
+                proc->pid, fault_addr, regs->eip);
+        process_exit_group(proc, -1);
+        return;
+    }
+    
+    kprintf("\n!!! EXCEPTION: %s !!!\n", exception_messages[14]);
+    kprintf("Address: %x (%s, %s, %s)\n", fault_addr,
+            (regs->err_code & PF_PRESENT) ? "protection" : "not present",
+            (regs->err_code & PF_WRITE) ? "write" : "read",
+            (regs->err_code & PF_USER) ? "user" : "kernel");
+    kprintf("EIP: %x\n", regs->eip);
+    kprintf("System halted.\n");
+    
+    __asm__ volatile("cli; hlt");
+}
+
 void isr_init(void) {
     /* Set up ISR gates for CPU exceptions (0-31) */
     idt_set_gate(0, (uint32_t)isr0, 0x08, 0x8E);
@@ -116,6 +161,8 @@ void isr_init(void) {
     for (int i = 0; i < 256; i++) {
         isr_handlers[i] = 0;
     }
+    
+    isr_register_handler(14, page_fault_handler);
 }
 
 void isr_register_handler(uint8_t n, isr_handler_t handler) {
@@ -197,6 +244,9 @@ __asm__(
     "isr_common_stub:\n"
     "   pusha\n"
     "   push %ds\n"
+    "   push %es\n"
+    "   push %fs\n"
+    "   push %gs\n"
     "   mov $0x10, %ax\n"
     "   mov %ax, %ds\n"
     "   mov %ax, %es\n"
@@ -205,6 +255,12 @@ __asm__(
     "   push %esp\n"
     "   call isr_handler\n"
     "   add $4, %esp\n"
+    "\n"
+    ".global interrupt_return\n"
+    "interrupt_return:\n"
+    "   pop %gs\n"
+    "   pop %fs\n"
+    "   pop %es\n"
     "   pop %ds\n"
     "   popa\n"
     "   add $8, %esp\n"
@@ -5,9 +5,10 @@
 
 #include <stdint.h>
 
-/* Registers pushed by ISR stub */
+/* Registers pushed by ISR stub (the trap frame; the same layout is used
+ * by IRQs and system calls) */
 typedef struct {
-    uint32_t ds;
+    uint32_t gs, fs, es, ds;
     uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax;
     uint32_t int_no, err_code;
     uint32_t eip, cs, eflags, useresp, ss;
@@ -22,4 +23,8 @@ typedef void (*isr_handler_t)(registers_t*);
 /* Register an ISR handler */
 void isr_register_handler(uint8_t n, isr_handler_t handler);
 
+/* Restore a trap frame at the stack pointer and iret (assembly; every
+ * interrupt stub ends here, new processes start here) */
+extern void interrupt_return(void);
+
 #endif /* ISR_H */
\ No newline at end of file
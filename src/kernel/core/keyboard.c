@@ -6,6 +6,7 @@
 #include "irq.h"
 #include "isr.h"
 #include "console.h"
+#include "../proc/wait.h"
 
 /* Keyboard I/O port */
 #define KEYBOARD_DATA_PORT 0x60
@@ -30,6 +31,9 @@ static char kb_buffer[KB_BUFFER_SIZE];
 static volatile int kb_read_pos = 0;
 static volatile int kb_write_pos = 0;
 
+/* Readers sleeping until a character arrives */
+static wait_queue_t kb_wait = WAIT_QUEUE_INIT;
+
 /* Keyboard state */
 static volatile int shift_pressed = 0;
 static volatile int ctrl_pressed = 0;
@@ -112,6 +116,7 @@ static void keyboard_handler(registers_t* regs) {
             kb_buffer[kb_write_pos] = c;
             kb_write_pos = next_pos;
         }
+        wake_up_interactive(&kb_wait);
     }
 }
 
@@ -137,23 +142,30 @@ int keyboard_has_char(void) {
 }
 
 char keyboard_get_char(void) {
-    while (!keyboard_has_char()) {
-        /* Wait for character */
-        __asm__ volatile("hlt");
+    /* Sleep until the IRQ handler wakes us; 0 means the wait was cut
+     * short because the process was killed */
+    if (wait_event_interruptible(kb_wait, keyboard_has_char()) < 0) {
+        return 0;
     }
     
+    uint32_t flags = wait_irq_save();
     char c = kb_buffer[kb_read_pos];
     kb_read_pos = (kb_read_pos + 1) % KB_BUFFER_SIZE;
+    wait_irq_restore(flags);
+    
     return c;
 }
 
-void keyboard_read_line(char* buffer, size_t max_len) {
+int keyboard_read_line(char* buffer, size_t max_len) {
     size_t pos = 0;
     
     while (pos < max_len - 1) {
         char c = keyboard_get_char();
         
-        if (c == '\n') {
+        if (c == 0) {
+            buffer[pos] = '\0';
+            return -1;
+        } else if (c == '\n') {
             console_putchar('\n');
             break;
         } else if (c == '\b') {
@@ -172,6 +184,7 @@ void keyboard_read_line(char* buffer, size_t max_len) {
     }
     
     buffer[pos] = '\0';
+    return (int)pos;
 }
 
 /* Get keyboard state for debugging */
@@ -12,13 +12,13 @@ typedef struct keyboard_layout_runtime keyboard_layout_runtime_t;
 /* Initialize keyboard */
 void keyboard_init(void);
 
-/* Read line (blocking) */
-void keyboard_read_line(char* buffer, size_t max_len);
+/* Read line (blocking); returns its length, -1 if the reader was killed */
+int keyboard_read_line(char* buffer, size_t max_len);
 
 /* Check if character is available */
 int keyboard_has_char(void);
 
-/* Get character (blocking) */
+/* Get character (blocking); 0 if the reader was killed */
 char keyboard_get_char(void);
 
 /* Get keyboard state (shift, ctrl, alt, capslock) */
@@ -9,9 +9,13 @@
 #include "isr.h"
 #include "irq.h"
 #include "timer.h"
+#include "multiboot.h"
 #include "../mm/memory.h"
+#include "../mm/pmm.h"
 #include "../mm/heap.h"
+#include "../mm/slab.h"
 #include "../mm/vmm.h"
+#include "../mm/swap.h"
 #include "../core/keyboard.h"
 #include "../core/keyboard_loader.h"
 #include "../drivers/driver.h"
@@ -25,35 +29,13 @@
 #include "../proc/syscall.h"
 #include "../shell.h"
 
-/* Multiboot header structure */
-struct multiboot_info {
-    uint32_t flags;
-    uint32_t mem_lower;
-    uint32_t mem_upper;
-    uint32_t boot_device;
-    uint32_t cmdline;
-    uint32_t mods_count;
-    uint32_t mods_addr;
-    uint32_t syms[4];
-    uint32_t mmap_length;
-    uint32_t mmap_addr;
-} __attribute__((packed));
-
-/* Multiboot module structure */
-struct multiboot_module {
-    uint32_t mod_start;
-    uint32_t mod_end;
-    uint32_t string;
-    uint32_t reserved;
-} __attribute__((packed));
-
 /* Kernel entry point */
 void kmain(uint32_t magic, struct multiboot_info* mboot) {
     /* Initialize console */
     console_init();
     
     /* Verify multiboot magic */
-    if (magic != 0x2BADB002) {
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC) {
         console_write("Error: Not loaded by multiboot bootloader!\n");
         return;
     }
@@ -90,19 +72,20 @@ void kmain(uint32_t magic, struct multiboot_info* mboot) {
     
     /* Initialize memory */
     console_write("[*] Initializing Memory...\n");
-    uint32_t total_kb = mboot->mem_lower + mboot->mem_upper;
-    memory_init(total_kb);
-    kprintf("    Memory: %u KB total\n", total_kb);
-    
-    /* Initialize heap */
-    console_write("[*] Initializing Heap...\n");
-    heap_init();
-    kprintf("    Heap initialized\n");
+    memory_init(mboot);
+    pmm_init();
+    kprintf("    Memory: %u KB total\n", memory_get_total());
     
     /* Initialize VMM */
     console_write("[*] Initializing Virtual Memory...\n");
     vmm_init();
     
+    /* Initialize heap (backed by VMM frames) */
+    console_write("[*] Initializing Heap...\n");
+    heap_init();
+    slab_init();
+    kprintf("    Heap initialized\n");
+    
     /* Initialize keyboard (basic) */
     console_write("[*] Initializing Keyboard...\n");
     keyboard_init();
@@ -118,6 +101,7 @@ void kmain(uint32_t magic, struct multiboot_info* mboot) {
     /* Initialize ATA driver */
     console_write("[*] Initializing ATA Driver...\n");
     ata_init();
+    swap_init();
     
     /* Note: USB support is a stub for now */
     console_write("[*] USB support: stub only\n");
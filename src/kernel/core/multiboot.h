@@ -0,0 +1,49 @@
+/* multiboot.h - Multiboot v1 boot information structures */
+
+#ifndef MULTIBOOT_H
+#define MULTIBOOT_H
+
+#include <stdint.h>
+
+#define MULTIBOOT_BOOTLOADER_MAGIC 0x2BADB002
+
+/* multiboot_info flags */
+#define MULTIBOOT_INFO_MEMORY   0x001    /* mem_lower/mem_upper valid */
+#define MULTIBOOT_INFO_CMDLINE  0x004
+#define MULTIBOOT_INFO_MODS     0x008
+#define MULTIBOOT_INFO_MMAP     0x040    /* mmap_addr/mmap_length valid */
+
+/* Memory map entry types */
+#define MULTIBOOT_MEMORY_AVAILABLE 1
+
+/* Multiboot header structure */
+struct multiboot_info {
+    uint32_t flags;
+    uint32_t mem_lower;
+    uint32_t mem_upper;
+    uint32_t boot_device;
+    uint32_t cmdline;
+    uint32_t mods_count;
+    uint32_t mods_addr;
+    uint32_t syms[4];
+    uint32_t mmap_length;
+    uint32_t mmap_addr;
+} __attribute__((packed));
+
+/* Multiboot module structure */
+struct multiboot_module {
+    uint32_t mod_start;
+    uint32_t mod_end;
+    uint32_t string;
+    uint32_t reserved;
+} __attribute__((packed));
+
+/* Memory map entry ('size' does not count itself) */
+struct multiboot_mmap_entry {
+    uint32_t size;
+    uint64_t addr;
+    uint64_t len;
+    uint32_t type;
+} __attribute__((packed));
+
+#endif /* MULTIBOOT_H */
@@ -1,20 +1,127 @@
-/* timer.c - System timer implementation using PIT */
+/* timer.c - System timer implementation using PIT
+ *
+ * Kernel timers live on a hierarchical timing wheel: WHEEL_LEVELS levels
+ * of WHEEL_SIZE slots, each level covering WHEEL_SIZE times the range of
+ * the one below. A timer due within WHEEL_SIZE ticks sits in the level 0
+ * slot of its exact tick; later ones sit in a coarser slot and are
+ * spread one level down each time the level below completes a lap.
+ * Adding, cancelling and expiring a timer are all O(1), and a tick with
+ * nothing due only looks at one slot.
+ */
 
 #include "timer.h"
 #include "pit.h"
 #include "irq.h"
 #include "isr.h"
+#include "../proc/scheduler.h"
 
-/* Timer frequency (100 Hz = 10ms per tick) */
-#define TIMER_FREQ 100
+#define MS_PER_TICK (1000 / TIMER_FREQ)
+
+/* Timing wheel geometry: 4 x 64 slots reach 2^24 ticks (46 hours) */
+#define WHEEL_BITS      6
+#define WHEEL_SIZE      (1 << WHEEL_BITS)
+#define WHEEL_MASK      (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS    4
+#define WHEEL_MAX_DELTA ((1U << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
 
 /* Tick counter */
 static volatile uint32_t tick_count = 0;
 
+static ktimer_t* wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static uint32_t wheel_tick = 0;     /* Next tick the wheel has to process */
+
+/* Disable interrupts, returning the previous flags */
+static inline uint32_t irq_save(void) {
+    uint32_t flags;
+    __asm__ volatile("pushf; pop %0; cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+/* Restore the flags saved by irq_save */
+static inline void irq_restore(uint32_t flags) {
+    __asm__ volatile("push %0; popf" :: "r"(flags) : "memory", "cc");
+}
+
+/* Link a timer into the slot matching its distance from wheel_tick */
+static void wheel_insert(ktimer_t* timer) {
+    uint32_t delta = timer->expires - wheel_tick;
+    ktimer_t** slot;
+    
+    if ((int32_t)delta < 0) {
+        /* Already due: run on the next tick processed */
+        slot = &wheel[0][wheel_tick & WHEEL_MASK];
+    } else {
+        if (delta > WHEEL_MAX_DELTA) {
+            delta = WHEEL_MAX_DELTA;
+            timer->expires = wheel_tick + delta;
+        }
+        
+        int level = 0;
+        while (delta >= (1U << (WHEEL_BITS * (level + 1)))) {
+            level++;
+        }
+        slot = &wheel[level][(timer->expires >> (WHEEL_BITS * level)) & WHEEL_MASK];
+    }
+    
+    timer->next = *slot;
+    if (timer->next) {
+        timer->next->pprev = &timer->next;
+    }
+    timer->pprev = slot;
+    *slot = timer;
+}
+
+/* Unlink a pending timer */
+static void wheel_remove(ktimer_t* timer) {
+    *timer->pprev = timer->next;
+    if (timer->next) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+/* Redistribute one slot of a coarser level into the levels below */
+static void wheel_cascade(int level, uint32_t index) {
+    ktimer_t* timer = wheel[level][index];
+    wheel[level][index] = NULL;
+    
+    while (timer) {
+        ktimer_t* next = timer->next;
+        wheel_insert(timer);
+        timer = next;
+    }
+}
+
+/* Expire the timers due up to the current tick */
+static void timer_run(void) {
+    while ((int32_t)(tick_count - wheel_tick) >= 0) {
+        uint32_t index = wheel_tick & WHEEL_MASK;
+        
+        /* Level 0 starts a new lap: bring the next slot of each level
+         * whose lap also wrapped down */
+        uint32_t upper = index;
+        for (int level = 1; upper == 0 && level < WHEEL_LEVELS; level++) {
+            upper = (wheel_tick >> (WHEEL_BITS * level)) & WHEEL_MASK;
+            wheel_cascade(level, upper);
+        }
+        
+        /* Timers re-armed by callbacks land in later slots */
+        wheel_tick++;
+        ktimer_t** slot = &wheel[0][index];
+        while (*slot) {
+            ktimer_t* timer = *slot;
+            wheel_remove(timer);
+            timer->callback(timer->data);
+        }
+    }
+}
+
 /* Timer IRQ handler */
 static void timer_handler(registers_t* regs) {
-    (void)regs;
     tick_count++;
+    timer_run();
+    scheduler_tick((regs->cs & 3) == 3);
 }
 
 void timer_init(void) {
@@ -30,6 +137,75 @@ uint32_t timer_get_ticks(void) {
 }
 
 uint32_t timer_get_uptime_ms(void) {
-    /* Each tick is 10ms at 100Hz */
-    return tick_count * 10;
+    return tick_count * MS_PER_TICK;
+}
+
+/* Milliseconds to ticks, rounded up */
+uint32_t timer_ms_to_ticks(uint32_t ms) {
+    return ms / MS_PER_TICK + (ms % MS_PER_TICK != 0);
+}
+
+/* Arm a timer */
+void timer_add(ktimer_t* timer, uint32_t ticks, timer_callback_t callback, void* data) {
+    uint32_t flags = irq_save();
+    
+    if (timer->pprev) {
+        wheel_remove(timer);
+    }
+    timer->expires = tick_count + ticks;
+    timer->callback = callback;
+    timer->data = data;
+    wheel_insert(timer);
+    
+    irq_restore(flags);
+}
+
+/* Disarm a timer */
+int timer_cancel(ktimer_t* timer) {
+    uint32_t flags = irq_save();
+    
+    int pending = timer->pprev != NULL;
+    if (pending) {
+        wheel_remove(timer);
+    }
+    
+    irq_restore(flags);
+    return pending;
+}
+
+int timer_pending(const ktimer_t* timer) {
+    return timer->pprev != NULL;
+}
+
+/* Sleep timer callback */
+static void timer_wake(void* data) {
+    scheduler_wakeup((process_t*)data);
+}
+
+/* Block the current process for at least ms milliseconds */
+void timer_sleep(uint32_t ms) {
+    if (ms == 0) return;
+    
+    /* One extra tick covers the part of the current tick already gone */
+    uint32_t ticks = timer_ms_to_ticks(ms) + 1;
+    process_t* current = process_get_current();
+    
+    /* Before process management is up there is nobody to switch to */
+    if (!current) {
+        uint32_t end = tick_count + ticks;
+        while ((int32_t)(tick_count - end) < 0) {
+            __asm__ volatile("hlt");
+        }
+        return;
+    }
+    
+    uint32_t flags = irq_save();
+    
+    ktimer_t* timer = &current->sleep_timer;
+    timer_add(timer, ticks, timer_wake, current);
+    while (timer_pending(timer)) {
+        scheduler_block();
+    }
+    
+    irq_restore(flags);
 }
\ No newline at end of file
@@ -5,6 +5,22 @@
 
 #include <stdint.h>
 
+/* Timer frequency (100 Hz = 10ms per tick) */
+#define TIMER_FREQ 100
+
+/* Called from the timer interrupt (interrupts disabled) */
+typedef void (*timer_callback_t)(void* data);
+
+/* A one-shot kernel timer. The caller owns the storage, zeroes it before
+ * first use and keeps it valid until the timer fires or is cancelled. */
+typedef struct ktimer {
+    uint32_t expires;                /* Tick it fires on */
+    timer_callback_t callback;
+    void* data;
+    struct ktimer* next;             /* Wheel slot list */
+    struct ktimer** pprev;           /* NULL when not pending */
+} ktimer_t;
+
 /* Initialize timer */
 void timer_init(void);
 
@@ -14,4 +30,20 @@ uint32_t timer_get_ticks(void);
 /* Get uptime in milliseconds */
 uint32_t timer_get_uptime_ms(void);
 
-#endif /* TIMER_H */
\ No newline at end of file
+/* Milliseconds to ticks, rounded up */
+uint32_t timer_ms_to_ticks(uint32_t ms);
+
+/* Arm a timer to run callback(data) ticks ticks from now (re-arms it if
+ * it was pending) */
+void timer_add(ktimer_t* timer, uint32_t ticks, timer_callback_t callback, void* data);
+
+/* Disarm a timer; returns 1 if it was pending, 0 if it already fired */
+int timer_cancel(ktimer_t* timer);
+
+/* Whether a timer is armed and has not fired yet */
+int timer_pending(const ktimer_t* timer);
+
+/* Block the current process for at least ms milliseconds */
+void timer_sleep(uint32_t ms);
+
+#endif /* TIMER_H */
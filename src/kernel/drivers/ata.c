@@ -3,6 +3,7 @@
 #include "ata.h"
 #include "driver.h"
 #include "../core/console.h"
+#include "../core/timer.h"
 
 /* Drive information */
 typedef struct {
@@ -13,6 +14,13 @@ typedef struct {
 
 static ata_drive_info_t drives[4]; /* Primary master/slave, Secondary master/slave */
 
+/* Status polls give up after ATA_TIMEOUT_MS, measured by a kernel timer.
+ * With interrupts off (page fault path) the tick does not advance, so
+ * ATA_MAX_POLLS bounds the wait there. The driver has no locking, so it
+ * polls rather than sleeping in the middle of a command. */
+#define ATA_TIMEOUT_MS 1000
+#define ATA_MAX_POLLS  1000000
+
 /* Port I/O functions */
 static inline void outb(uint16_t port, uint8_t value) {
     __asm__ volatile("outb %0, %1" : : "a"(value), "Nd"(port));
@@ -32,35 +40,44 @@ static inline void outw_buffer(uint16_t port, const uint16_t* buffer, uint32_t c
     __asm__ volatile("rep outsw" : "+S"(buffer), "+c"(count) : "d"(port) : "memory");
 }
 
-/* Wait for drive to be ready */
-static int ata_wait_ready(uint16_t base) {
-    uint32_t timeout = 100000;
+/* Timeout timer callback */
+static void ata_timeout(void* data) {
+    *(volatile int*)data = 1;
+}
+
+/* Poll the status port until (status & mask) == want; fails on ERR when
+ * fail_on_err is set, or on timeout */
+static int ata_poll(uint16_t base, uint8_t mask, uint8_t want, int fail_on_err) {
+    volatile int expired = 0;
+    ktimer_t timer = {0};
+    int result = -1;
     
-    while (timeout--) {
+    timer_add(&timer, timer_ms_to_ticks(ATA_TIMEOUT_MS), ata_timeout, (void*)&expired);
+    
+    for (uint32_t polls = 0; polls < ATA_MAX_POLLS && !expired; polls++) {
         uint8_t status = inb(base + 7); /* Status port */
-        if ((status & ATA_SR_BSY) == 0 && (status & ATA_SR_DRDY)) {
-            return 0;
+        if ((status & mask) == want) {
+            result = 0;
+            break;
+        }
+        if (fail_on_err && (status & ATA_SR_ERR)) {
+            break;
         }
+        __asm__ volatile("pause");
     }
     
-    return -1; /* Timeout */
+    timer_cancel(&timer);
+    return result;
+}
+
+/* Wait for drive to be ready */
+static int ata_wait_ready(uint16_t base) {
+    return ata_poll(base, ATA_SR_BSY | ATA_SR_DRDY, ATA_SR_DRDY, 0);
 }
 
 /* Wait for DRQ (data request) */
 static int ata_wait_drq(uint16_t base) {
-    uint32_t timeout = 100000;
-    
-    while (timeout--) {
-        uint8_t status = inb(base + 7);
-        if (status & ATA_SR_DRQ) {
-            return 0;
-        }
-        if (status & ATA_SR_ERR) {
-            return -1;
-        }
-    }
-    
-    return -1; /* Timeout */
+    return ata_poll(base, ATA_SR_DRQ, ATA_SR_DRQ, 1);
 }
 
 /* Select drive */
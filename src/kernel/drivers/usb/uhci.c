@@ -4,6 +4,10 @@
 #include "usb_core.h"
 #include "../pci.h"
 #include "../../core/console.h"
+#include "../../core/timer.h"
+
+/* Register changes are checked once per tick for up to this long */
+#define UHCI_TIMEOUT_MS 100
 
 /* Port I/O */
 static inline void outw(uint16_t port, uint16_t value) {
@@ -58,6 +62,19 @@ void uhci_init(void) {
     kprintf("[UHCI] UHCI controller initialized (stub)\n");
 }
 
+/* Sleep until (register & mask) == want; -1 on timeout */
+static int uhci_wait(uint16_t port, uint16_t mask, uint16_t want) {
+    uint32_t end = timer_get_ticks() + timer_ms_to_ticks(UHCI_TIMEOUT_MS);
+    
+    while ((inw(port) & mask) != want) {
+        if ((int32_t)(timer_get_ticks() - end) >= 0) {
+            return -1;
+        }
+        timer_sleep(1);
+    }
+    return 0;
+}
+
 /* Reset UHCI controller */
 int uhci_reset(uint16_t io_base) {
     kprintf("[UHCI] Resetting controller...\n");
@@ -66,16 +83,7 @@ int uhci_reset(uint16_t io_base) {
     outw(io_base + UHCI_USBCMD, UHCI_CMD_HCRESET);
     
     /* Wait for reset to complete */
-    int timeout = 1000;
-    while (timeout-- > 0) {
-        if (!(inw(io_base + UHCI_USBCMD) & UHCI_CMD_HCRESET)) {
-            break;
-        }
-        /* Small delay */
-        for (volatile int i = 0; i < 1000; i++);
-    }
-    
-    if (timeout <= 0) {
+    if (uhci_wait(io_base + UHCI_USBCMD, UHCI_CMD_HCRESET, 0) < 0) {
         return -1;
     }
     
@@ -93,15 +101,7 @@ int uhci_start(uint16_t io_base) {
     outw(io_base + UHCI_USBCMD, cmd);
     
     /* Wait for controller to start */
-    int timeout = 1000;
-    while (timeout-- > 0) {
-        if (!(inw(io_base + UHCI_USBSTS) & UHCI_STS_HCH)) {
-            break;
-        }
-        for (volatile int i = 0; i < 1000; i++);
-    }
-    
-    if (timeout <= 0) {
+    if (uhci_wait(io_base + UHCI_USBSTS, UHCI_STS_HCH, 0) < 0) {
         return -1;
     }
     
@@ -119,15 +119,7 @@ int uhci_stop(uint16_t io_base) {
     outw(io_base + UHCI_USBCMD, cmd);
     
     /* Wait for controller to halt */
-    int timeout = 1000;
-    while (timeout-- > 0) {
-        if (inw(io_base + UHCI_USBSTS) & UHCI_STS_HCH) {
-            break;
-        }
-        for (volatile int i = 0; i < 1000; i++);
-    }
-    
-    if (timeout <= 0) {
+    if (uhci_wait(io_base + UHCI_USBSTS, UHCI_STS_HCH, UHCI_STS_HCH) < 0) {
         return -1;
     }
     
@@ -4,10 +4,12 @@
 #include "vfs.h"
 #include "../drivers/driver.h"
 #include "../mm/heap.h"
+#include "../mm/slab.h"
 #include "../core/console.h"
 
 #define BLOCK_SIZE 4096
 #define SUPERBLOCK_OFFSET 1024
+#define EXT4_MAX_LOG_BLOCK_SIZE 6   /* 1K << 6 = 64K blocks */
 
 /* EXT4 filesystem state */
 typedef struct {
@@ -18,8 +20,16 @@ typedef struct {
     uint32_t inodes_per_group;
     uint32_t blocks_per_group;
     uint32_t num_block_groups;
+    kmem_cache_t* block_cache;       /* Temporary block buffers */
 } ext4_fs_t;
 
+/* Block buffer caches, one per block size, shared by all mounts */
+static kmem_cache_t* block_caches[EXT4_MAX_LOG_BLOCK_SIZE + 1];
+static const char* block_cache_names[EXT4_MAX_LOG_BLOCK_SIZE + 1] = {
+    "ext4_block_1k", "ext4_block_2k", "ext4_block_4k", "ext4_block_8k",
+    "ext4_block_16k", "ext4_block_32k", "ext4_block_64k"
+};
+
 /* String utilities */
 static void* memcpy(void* dest, const void* src, size_t n) {
     uint8_t* d = dest;
@@ -42,6 +52,17 @@ static int strcmp(const char* s1, const char* s2) {
     return *(unsigned char*)s1 - *(unsigned char*)s2;
 }
 
+/* Get buffer cache for block size 1K << log_size */
+static kmem_cache_t* ext4_get_block_cache(uint32_t log_size) {
+    if (log_size > EXT4_MAX_LOG_BLOCK_SIZE) return NULL;
+    
+    if (!block_caches[log_size]) {
+        block_caches[log_size] = kmem_cache_create(block_cache_names[log_size],
+                                                   1024 << log_size, 0, NULL);
+    }
+    return block_caches[log_size];
+}
+
 /* Read block from device */
 static int ext4_read_block(ext4_fs_t* fs, uint32_t block_num, void* buffer) {
     if (!fs || !buffer) return -1;
@@ -126,6 +147,13 @@ vfs_node_t* ext4_mount(const char* device) {
     }
     
     /* Calculate filesystem parameters */
+    fs->block_cache = ext4_get_block_cache(fs->superblock.s_log_block_size);
+    if (!fs->block_cache) {
+        kprintf("[EXT4] Unsupported block size (log %u)\n", fs->superblock.s_log_block_size);
+        kfree(fs);
+        return NULL;
+    }
+    
     fs->block_size = 1024 << fs->superblock.s_log_block_size;
     fs->inode_size = fs->superblock.s_inode_size;
     fs->inodes_per_group = fs->superblock.s_inodes_per_group;
@@ -142,14 +170,13 @@ vfs_node_t* ext4_mount(const char* device) {
     kprintf("[EXT4]   Volume: %s\n", fs->superblock.s_volume_name);
     
     /* Create VFS root node */
-    vfs_node_t* root = (vfs_node_t*)kmalloc(sizeof(vfs_node_t));
+    vfs_node_t* root = vfs_alloc_node();
     if (!root) {
         kprintf("[EXT4] Out of memory\n");
         kfree(fs);
         return NULL;
     }
     
-    memset(root, 0, sizeof(vfs_node_t));
     root->flags = VFS_DIRECTORY | VFS_MOUNTPOINT;
     root->inode = EXT4_ROOT_INO;
     root->impl = (uint32_t)fs;
@@ -184,7 +211,7 @@ int ext4_umount(vfs_node_t* node) {
         kfree(fs);
     }
     
-    kfree(node);
+    vfs_free_node(node);
     
     return 0;
 }
@@ -281,18 +308,18 @@ int ext4_read_inode(vfs_node_t* fs_root, uint32_t inode_num, ext4_inode_t* inode
     uint32_t byte_offset = (index * fs->inode_size) % fs->block_size;
     
     /* Read block containing inode */
-    uint8_t* block_buffer = (uint8_t*)kmalloc(fs->block_size);
+    uint8_t* block_buffer = (uint8_t*)kmem_cache_alloc(fs->block_cache);
     if (!block_buffer) return -1;
     
     if (ext4_read_block(fs, inode_table_block + block_offset, block_buffer) < 0) {
-        kfree(block_buffer);
+        kmem_cache_free(fs->block_cache, block_buffer);
         return -1;
     }
     
     /* Copy inode data */
     memcpy(inode, block_buffer + byte_offset, sizeof(ext4_inode_t));
     
-    kfree(block_buffer);
+    kmem_cache_free(fs->block_cache, block_buffer);
     
     return 0;
 }
@@ -313,11 +340,11 @@ int ext4_write_inode(vfs_node_t* fs_root, uint32_t inode_num, const ext4_inode_t
     uint32_t byte_offset = (index * fs->inode_size) % fs->block_size;
     
     /* Read-modify-write */
-    uint8_t* block_buffer = (uint8_t*)kmalloc(fs->block_size);
+    uint8_t* block_buffer = (uint8_t*)kmem_cache_alloc(fs->block_cache);
     if (!block_buffer) return -1;
     
     if (ext4_read_block(fs, inode_table_block + block_offset, block_buffer) < 0) {
-        kfree(block_buffer);
+        kmem_cache_free(fs->block_cache, block_buffer);
         return -1;
     }
     
@@ -327,7 +354,7 @@ int ext4_write_inode(vfs_node_t* fs_root, uint32_t inode_num, const ext4_inode_t
     /* Write back */
     int result = ext4_write_block(fs, inode_table_block + block_offset, block_buffer);
     
-    kfree(block_buffer);
+    kmem_cache_free(fs->block_cache, block_buffer);
     
     return result;
 }
@@ -404,11 +431,11 @@ int ext4_read_inode_data(vfs_node_t* fs_root, ext4_inode_t* inode,
     }
     
     /* Read block */
-    uint8_t* temp_buffer = (uint8_t*)kmalloc(fs->block_size);
+    uint8_t* temp_buffer = (uint8_t*)kmem_cache_alloc(fs->block_cache);
     if (!temp_buffer) return -1;
     
     if (ext4_read_block(fs, physical_block, temp_buffer) < 0) {
-        kfree(temp_buffer);
+        kmem_cache_free(fs->block_cache, temp_buffer);
         return -1;
     }
     
@@ -419,7 +446,7 @@ int ext4_read_inode_data(vfs_node_t* fs_root, ext4_inode_t* inode,
     }
     
     memcpy(buffer, temp_buffer + block_offset, to_copy);
-    kfree(temp_buffer);
+    kmem_cache_free(fs->block_cache, temp_buffer);
     
     return to_copy;
 }
@@ -451,7 +478,7 @@ int ext4_write_inode_data(vfs_node_t* fs_root, ext4_inode_t* inode,
     uint32_t physical_block = inode->i_block[block_num];
     
     /* Read-modify-write */
-    uint8_t* temp_buffer = (uint8_t*)kmalloc(fs->block_size);
+    uint8_t* temp_buffer = (uint8_t*)kmem_cache_alloc(fs->block_cache);
     if (!temp_buffer) return -1;
     
     if (ext4_read_block(fs, physical_block, temp_buffer) < 0) {
@@ -468,7 +495,7 @@ int ext4_write_inode_data(vfs_node_t* fs_root, ext4_inode_t* inode,
     
     /* Write back */
     int result = ext4_write_block(fs, physical_block, temp_buffer);
-    kfree(temp_buffer);
+    kmem_cache_free(fs->block_cache, temp_buffer);
     
     return (result == 0) ? to_copy : -1;
 }
\ No newline at end of file
@@ -2,7 +2,7 @@
 
 #include "initrd.h"
 #include "vfs.h"
-#include "../mm/heap.h"
+#include "../mm/vmm.h"
 
 #define MAX_FILES 64
 
@@ -71,6 +71,18 @@ static int initrd_read(vfs_node_t* node, uint32_t offset, uint32_t size, uint8_t
     return size;
 }
 
+/* VFS map callback: whole pages that happen to be page-aligned inside the
+ * (identity-mapped, reserved) module can be mapped as is */
+static uint32_t initrd_map(vfs_node_t* node, uint32_t offset) {
+    initrd_file_t* file = (initrd_file_t*)node->impl;
+    if (!file || offset + PAGE_SIZE > file->size) return 0;
+    
+    uint32_t addr = (uint32_t)(file->data + offset);
+    if ((addr & (PAGE_SIZE - 1)) || addr >= LOWMEM_END) return 0;
+    
+    return addr;
+}
+
 /* VFS readdir callback */
 static vfs_node_t* initrd_readdir(vfs_node_t* node, uint32_t index) {
     (void)node;
@@ -155,7 +167,7 @@ int initrd_init(uint32_t addr, uint32_t size) {
             f->data = data + header_size;
             
             /* Create VFS node */
-            vfs_node_t* vnode = (vfs_node_t*)kmalloc(sizeof(vfs_node_t));
+            vfs_node_t* vnode = vfs_alloc_node();
             if (vnode) {
                 strncpy(vnode->name, f->name, 128);
                 vnode->mask = 0;
@@ -171,6 +183,7 @@ int initrd_init(uint32_t addr, uint32_t size) {
                 vnode->close = NULL;
                 vnode->readdir = NULL;
                 vnode->finddir = NULL;
+                vnode->map = initrd_map;
                 vnode->ptr = NULL;
                 
                 f->vfs_node = vnode;
@@ -188,7 +201,7 @@ int initrd_init(uint32_t addr, uint32_t size) {
     }
     
     /* Create root directory node */
-    initrd_root = (vfs_node_t*)kmalloc(sizeof(vfs_node_t));
+    initrd_root = vfs_alloc_node();
     if (initrd_root) {
         strncpy(initrd_root->name, "initrd", 128);
         initrd_root->mask = 0;
@@ -4,6 +4,7 @@
 #include "initrd.h"
 #include "path.h"
 #include "../mm/heap.h"
+#include "../mm/slab.h"
 #include "../core/console.h"
 
 /* File open flags */
@@ -37,6 +38,10 @@ typedef struct mount_point {
 
 static mount_point_t* mount_list = NULL;
 
+/* Object caches for nodes and mount points */
+static kmem_cache_t* node_cache = NULL;
+static kmem_cache_t* mount_cache = NULL;
+
 /* String utilities */
 static int strcmp(const char* s1, const char* s2) {
     while (*s1 && (*s1 == *s2)) {
@@ -88,6 +93,35 @@ static void* memcpy(void* dest, const void* src, size_t n) {
     return dest;
 }
 
+/* Create VFS object caches (nodes may be needed before vfs_init) */
+static void vfs_caches_init(void) {
+    if (!node_cache) {
+        node_cache = kmem_cache_create("vfs_node", sizeof(vfs_node_t), 0, NULL);
+    }
+    if (!mount_cache) {
+        mount_cache = kmem_cache_create("mount_point", sizeof(mount_point_t), 0, NULL);
+    }
+}
+
+/* Allocate zeroed VFS node */
+vfs_node_t* vfs_alloc_node(void) {
+    if (!node_cache) {
+        vfs_caches_init();
+    }
+    
+    vfs_node_t* node = (vfs_node_t*)kmem_cache_alloc(node_cache);
+    if (node) {
+        memset(node, 0, sizeof(vfs_node_t));
+    }
+    return node;
+}
+
+/* Free VFS node */
+void vfs_free_node(vfs_node_t* node) {
+    if (!node) return;
+    kmem_cache_free(node_cache, node);
+}
+
 /* Initialize VFS */
 void vfs_init(void) {
     kprintf("[VFS] Initializing Virtual File System...\n");
@@ -101,6 +135,7 @@ void vfs_init(void) {
     
     /* Initialize mount list */
     mount_list = NULL;
+    vfs_caches_init();
     
     /* Initialize initrd as root filesystem */
     root_node = initrd_get_root();
@@ -109,7 +144,7 @@ void vfs_init(void) {
         kprintf("[VFS] Root filesystem mounted (initrd)\n");
         
         /* Create root mount point */
-        mount_point_t* root_mount = (mount_point_t*)kmalloc(sizeof(mount_point_t));
+        mount_point_t* root_mount = (mount_point_t*)kmem_cache_alloc(mount_cache);
         if (root_mount) {
             strcpy(root_mount->path, "/");
             strcpy(root_mount->fstype, "initrd");
@@ -306,6 +341,12 @@ int vfs_open(const char* path, int flags) {
     return fd;
 }
 
+/* Get node behind file descriptor */
+vfs_node_t* vfs_get_node(int fd) {
+    if (fd < 0 || fd >= MAX_FILE_DESCRIPTORS) return NULL;
+    return fd_table[fd].node;
+}
+
 /* Close file */
 int vfs_close(int fd) {
     if (fd < 0 || fd >= MAX_FILE_DESCRIPTORS || !fd_table[fd].node) {
@@ -517,7 +558,7 @@ int vfs_mount(const char* source, const char* target, const char* fstype) {
     }
     
     /* Create mount point structure */
-    mount_point_t* mp = (mount_point_t*)kmalloc(sizeof(mount_point_t));
+    mount_point_t* mp = (mount_point_t*)kmem_cache_alloc(mount_cache);
     if (!mp) return -1;
     
     strncpy(mp->path, target, 256);
@@ -533,13 +574,13 @@ int vfs_mount(const char* source, const char* target, const char* fstype) {
         mp->node = root_node;
     } else {
         kprintf("[VFS] Unknown filesystem type: %s\n", fstype);
-        kfree(mp);
+        kmem_cache_free(mount_cache, mp);
         return -1;
     }
     
     if (!mp->node) {
         kprintf("[VFS] Failed to mount filesystem\n");
-        kfree(mp);
+        kmem_cache_free(mount_cache, mp);
         return -1;
     }
     
@@ -579,7 +620,7 @@ int vfs_umount(const char* target) {
                 ext4_umount(mp->node);
             }
             
-            kfree(mp);
+            kmem_cache_free(mount_cache, mp);
             kprintf("[VFS] Unmounted successfully\n");
             return 0;
         }
@@ -25,6 +25,7 @@ typedef void (*vfs_open_t)(struct vfs_node*);
 typedef void (*vfs_close_t)(struct vfs_node*);
 typedef struct vfs_node* (*vfs_readdir_t)(struct vfs_node*, uint32_t);
 typedef struct vfs_node* (*vfs_finddir_t)(struct vfs_node*, const char*);
+typedef uint32_t (*vfs_map_t)(struct vfs_node*, uint32_t);
 
 /* VFS node structure */
 typedef struct vfs_node {
@@ -43,6 +44,7 @@ typedef struct vfs_node {
     vfs_close_t close;
     vfs_readdir_t readdir;
     vfs_finddir_t finddir;
+    vfs_map_t map;               /* Frame holding a page-aligned file page, 0 if none */
     
     struct vfs_node* ptr;        /* Used by mountpoints and symlinks */
 } vfs_node_t;
@@ -63,12 +65,17 @@ typedef struct {
 /* Initialize VFS */
 void vfs_init(void);
 
+/* Allocate/free VFS nodes (zeroed, from the node cache) */
+vfs_node_t* vfs_alloc_node(void);
+void vfs_free_node(vfs_node_t* node);
+
 /* File operations */
 int vfs_open(const char* path, int flags);
 int vfs_close(int fd);
 int vfs_read(int fd, void* buffer, size_t size);
 int vfs_write(int fd, const void* buffer, size_t size);
 int vfs_seek(int fd, int offset, int whence);
+vfs_node_t* vfs_get_node(int fd);
 
 /* Directory operations */
 int vfs_readdir(int fd, void* entry);
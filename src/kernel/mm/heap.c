@@ -1,136 +1,658 @@
-/* heap.c - Simple heap allocator implementation */
+/* heap.c - TLSF (two-level segregated fit) kernel heap allocator
+ *
+ * Free blocks are kept in a two-level array of segregated free lists.
+ * The first level splits sizes by powers of two, the second level splits
+ * each power-of-two range into HEAP_SL_COUNT linear classes. Two bitmaps
+ * record which lists are non-empty, so finding a suitable block and
+ * freeing one are both O(1) regardless of how many blocks exist.
+ *
+ * Every block carries a boundary tag (pointer to its physical predecessor)
+ * so kfree() can coalesce with both neighbours in constant time.
+ *
+ * The heap lives in a reserved virtual window [KHEAP_START, KHEAP_END).
+ * Only the front of the window is backed by frames; the heap grows on
+ * demand by mapping fresh frames at its end, and gives whole pages back
+ * when a large free block sits at the top.
+ *
+ * Building with HEAP_PROFILE adds a tag to every block header recording
+ * the return address of the allocating call and its size class, and keeps
+ * live/peak counters per call site so heap exhaustion and leaks can be
+ * traced back to their source (see the shell's heapprof command).
+ */
 
 #include "heap.h"
-#include "memory.h"
+#include "vmm.h"
+#ifdef HEAP_PROFILE
+#include "../core/console.h"
+#endif
 
 #define HEAP_MAGIC 0xDEADBEEF
 
+#define HEAP_INITIAL_SIZE (1024 * 1024)   /* 1MB mapped at boot */
+#define HEAP_DEFAULT_CHUNK (256 * 1024)   /* Default growth step */
+
+/* Allocation granularity */
+#define HEAP_ALIGN_LOG2 2
+#define HEAP_ALIGN      (1 << HEAP_ALIGN_LOG2)
+
+/* Second level: 16 linear classes per power of two */
+#define HEAP_SL_LOG2    4
+#define HEAP_SL_COUNT   (1 << HEAP_SL_LOG2)
+
+/* First level: sizes below HEAP_SMALL_SIZE share first-level index 0 */
+#define HEAP_FL_SHIFT   (HEAP_SL_LOG2 + HEAP_ALIGN_LOG2)
+#define HEAP_FL_MAX     28                /* Largest class: 256MB blocks */
+#define HEAP_FL_COUNT   (HEAP_FL_MAX - HEAP_FL_SHIFT + 1)
+#define HEAP_SMALL_SIZE (1 << HEAP_FL_SHIFT)
+
+/* Block flags stored in the low bits of the size field */
+#define BLOCK_FREE      0x1
+#define BLOCK_FLAGS     0x3
+
 /* Heap block header */
 typedef struct heap_block {
+    struct heap_block* prev_phys;    /* Boundary tag: physically previous block */
     uint32_t magic;
-    uint32_t size;
-    uint8_t is_free;
-    struct heap_block* next;
+    uint32_t size;                   /* Payload size | flags */
+#ifdef HEAP_PROFILE
+    uint32_t caller;                 /* Return address of the allocating call */
+    uint16_t site;                   /* Index into site_table */
+    uint16_t size_class;             /* First-level class of the request */
+#endif
+
+    /* Free list links - only valid while the block is free (overlap payload) */
+    struct heap_block* next_free;
+    struct heap_block* prev_free;
 } heap_block_t;
 
-static heap_block_t* heap_start = NULL;
-static uint32_t heap_size = 0;
+/* Bytes of header in front of every payload */
+#define BLOCK_OVERHEAD  ((uint32_t)&((heap_block_t*)0)->next_free)
 
-/* Initialize heap */
-void heap_init(void) {
-    /* Heap starts after kernel end (already set up by memory_init) */
-    heap_start = (heap_block_t*)memory_get_heap_start();
-    heap_size = 1024 * 1024; /* 1MB initial heap */
-    
-    /* Create first free block */
-    heap_start->magic = HEAP_MAGIC;
-    heap_start->size = heap_size - sizeof(heap_block_t);
-    heap_start->is_free = 1;
-    heap_start->next = NULL;
+/* Smallest payload: must hold the free list links */
+#define BLOCK_SIZE_MIN  (sizeof(heap_block_t) - BLOCK_OVERHEAD)
+
+/* Free list heads and bitmaps */
+static uint32_t fl_bitmap = 0;
+static uint32_t sl_bitmap[HEAP_FL_COUNT];
+static heap_block_t* free_lists[HEAP_FL_COUNT][HEAP_SL_COUNT];
+
+static uint8_t* heap_start = NULL;
+static uint32_t heap_size = 0;           /* Bytes currently mapped */
+static uint32_t heap_high_water = 0;     /* Largest heap_size seen */
+static uint32_t heap_growth_chunk = HEAP_DEFAULT_CHUNK;
+
+/* Counters (replace list walks for statistics) */
+static uint32_t heap_used_bytes = 0;
+static uint32_t heap_free_bytes = 0;
+
+#ifdef HEAP_PROFILE
+/* Call-site table; slot 0 collects sites that did not fit */
+#define HEAP_PROFILE_SITES 128
+
+static heap_site_info_t site_table[HEAP_PROFILE_SITES];
+static uint32_t class_live[HEAP_FL_COUNT];      /* Live blocks per size class */
+#endif
+
+/* Bit helpers */
+static inline int heap_fls(uint32_t word) {
+    return word ? 31 - __builtin_clz(word) : -1;
 }
 
-/* Allocate memory */
-void* kmalloc(size_t size) {
-    if (size == 0) return NULL;
-    
-    /* Align to 4 bytes */
-    size = (size + 3) & ~3;
-    
-    /* Find free block */
-    heap_block_t* current = heap_start;
-    
-    while (current) {
-        if (current->magic != HEAP_MAGIC) {
-            /* Heap corruption */
-            return NULL;
+static inline int heap_ffs(uint32_t word) {
+    return word ? __builtin_ctz(word) : -1;
+}
+
+static inline uint32_t align_up(uint32_t x, uint32_t align) {
+    return (x + align - 1) & ~(align - 1);
+}
+
+/* Block helpers */
+static inline uint32_t block_size(const heap_block_t* block) {
+    return block->size & ~BLOCK_FLAGS;
+}
+
+static inline int block_is_free(const heap_block_t* block) {
+    return block->size & BLOCK_FREE;
+}
+
+static inline void* block_to_ptr(const heap_block_t* block) {
+    return (uint8_t*)block + BLOCK_OVERHEAD;
+}
+
+static inline heap_block_t* ptr_to_block(const void* ptr) {
+    return (heap_block_t*)((uint8_t*)ptr - BLOCK_OVERHEAD);
+}
+
+static inline heap_block_t* block_next(const heap_block_t* block) {
+    return (heap_block_t*)((uint8_t*)block_to_ptr(block) + block_size(block));
+}
+
+/* Compute list indices for a block of the given size */
+static void mapping_insert(uint32_t size, int* fl, int* sl) {
+    if (size < HEAP_SMALL_SIZE) {
+        *fl = 0;
+        *sl = size / (HEAP_SMALL_SIZE / HEAP_SL_COUNT);
+    } else {
+        int f = heap_fls(size);
+        *sl = (size >> (f - HEAP_SL_LOG2)) ^ HEAP_SL_COUNT;
+        *fl = f - (HEAP_FL_SHIFT - 1);
+    }
+}
+
+/* Compute list indices for a request, rounding up to the next class */
+static void mapping_search(uint32_t size, int* fl, int* sl) {
+    if (size >= HEAP_SMALL_SIZE) {
+        size += (1 << (heap_fls(size) - HEAP_SL_LOG2)) - 1;
+    }
+    mapping_insert(size, fl, sl);
+}
+
+/* Find a non-empty list at or above (fl, sl) */
+static heap_block_t* search_suitable_block(int* fl, int* sl) {
+    if (*fl >= HEAP_FL_COUNT) return NULL;
+
+    uint32_t sl_map = sl_bitmap[*fl] & (~0U << *sl);
+    if (!sl_map) {
+        /* No block in this first-level class - try larger classes */
+        uint32_t fl_map = (*fl + 1 < 32) ? fl_bitmap & (~0U << (*fl + 1)) : 0;
+        if (!fl_map) return NULL;
+
+        *fl = heap_ffs(fl_map);
+        sl_map = sl_bitmap[*fl];
+    }
+
+    *sl = heap_ffs(sl_map);
+    return free_lists[*fl][*sl];
+}
+
+/* Insert free block into its segregated list */
+static void insert_free_block(heap_block_t* block) {
+    int fl, sl;
+    mapping_insert(block_size(block), &fl, &sl);
+
+    heap_block_t* head = free_lists[fl][sl];
+    block->next_free = head;
+    block->prev_free = NULL;
+    if (head) {
+        head->prev_free = block;
+    }
+    free_lists[fl][sl] = block;
+
+    fl_bitmap |= (1U << fl);
+    sl_bitmap[fl] |= (1U << sl);
+
+    heap_free_bytes += block_size(block);
+}
+
+/* Remove free block from its segregated list */
+static void remove_free_block(heap_block_t* block) {
+    int fl, sl;
+    mapping_insert(block_size(block), &fl, &sl);
+
+    if (block->prev_free) {
+        block->prev_free->next_free = block->next_free;
+    } else {
+        free_lists[fl][sl] = block->next_free;
+    }
+    if (block->next_free) {
+        block->next_free->prev_free = block->prev_free;
+    }
+
+    if (!free_lists[fl][sl]) {
+        sl_bitmap[fl] &= ~(1U << sl);
+        if (!sl_bitmap[fl]) {
+            fl_bitmap &= ~(1U << fl);
         }
-        
-        if (current->is_free && current->size >= size) {
-            /* Found suitable block */
-            
-            /* Split block if remaining space is significant */
-            if (current->size > size + sizeof(heap_block_t) + 16) {
-                heap_block_t* new_block = (heap_block_t*)((uint8_t*)current + 
-                                          sizeof(heap_block_t) + size);
-                new_block->magic = HEAP_MAGIC;
-                new_block->size = current->size - size - sizeof(heap_block_t);
-                new_block->is_free = 1;
-                new_block->next = current->next;
-                
-                current->size = size;
-                current->next = new_block;
-            }
-            
-            current->is_free = 0;
-            return (void*)((uint8_t*)current + sizeof(heap_block_t));
+    }
+
+    heap_free_bytes -= block_size(block);
+}
+
+/* Split block so its payload is exactly size bytes; remainder becomes free */
+static void block_trim(heap_block_t* block, uint32_t size) {
+    if (block_size(block) < size + BLOCK_OVERHEAD + BLOCK_SIZE_MIN) {
+        return;
+    }
+
+    heap_block_t* remaining = (heap_block_t*)((uint8_t*)block_to_ptr(block) + size);
+    remaining->magic = HEAP_MAGIC;
+    remaining->size = (block_size(block) - size - BLOCK_OVERHEAD) | BLOCK_FREE;
+    remaining->prev_phys = block;
+    block_next(remaining)->prev_phys = remaining;
+
+    block->size = size | (block->size & BLOCK_FLAGS);
+    insert_free_block(remaining);
+}
+
+/* Mark a block as handed out */
+static void* block_mark_used(heap_block_t* block) {
+    block->size &= ~BLOCK_FREE;
+    heap_used_bytes += block_size(block) + BLOCK_OVERHEAD;
+    return block_to_ptr(block);
+}
+
+#ifdef HEAP_PROFILE
+/* Find or claim the site_table slot for a caller */
+static uint16_t profile_site(uint32_t caller) {
+    uint32_t slot = (caller >> 2) % (HEAP_PROFILE_SITES - 1);
+    for (int probe = 0; probe < HEAP_PROFILE_SITES - 1; probe++) {
+        heap_site_info_t* site = &site_table[slot + 1];
+        if (site->caller == caller) return slot + 1;
+        if (!site->caller) {
+            site->caller = caller;
+            return slot + 1;
+        }
+        slot = (slot + 1) % (HEAP_PROFILE_SITES - 1);
+    }
+    return 0;
+}
+
+/* Charge a freshly allocated block to its call site */
+static void profile_tag(heap_block_t* block, uint32_t caller) {
+    int fl, sl;
+    mapping_insert(block_size(block), &fl, &sl);
+
+    block->caller = caller;
+    block->site = profile_site(caller);
+    block->size_class = fl;
+
+    heap_site_info_t* site = &site_table[block->site];
+    site->live_bytes += block_size(block);
+    site->live_blocks++;
+    site->allocs++;
+    if (site->live_bytes > site->peak_bytes) {
+        site->peak_bytes = site->live_bytes;
+    }
+    class_live[fl]++;
+}
+
+/* Credit a block back to its call site before it is freed */
+static void profile_untag(heap_block_t* block) {
+    heap_site_info_t* site = &site_table[block->site];
+    site->live_bytes -= block_size(block);
+    site->live_blocks--;
+    class_live[block->size_class]--;
+}
+
+#define PROFILE_TAG(block, caller) profile_tag(block, caller)
+#define PROFILE_UNTAG(block)       profile_untag(block)
+#else
+#define PROFILE_TAG(block, caller) ((void)(caller))
+#define PROFILE_UNTAG(block)       ((void)(block))
+#endif
+
+/* Normalize a request size */
+static uint32_t adjust_request(size_t size) {
+    if (size == 0 || size > (1U << HEAP_FL_MAX)) return 0;
+
+    uint32_t adjusted = align_up(size, HEAP_ALIGN);
+    if (adjusted < BLOCK_SIZE_MIN) {
+        adjusted = BLOCK_SIZE_MIN;
+    }
+    return adjusted;
+}
+
+/* Locate and unlink a free block with at least size bytes of payload */
+static heap_block_t* locate_free_block(uint32_t size) {
+    int fl, sl;
+    mapping_search(size, &fl, &sl);
+
+    heap_block_t* block = search_suitable_block(&fl, &sl);
+    if (!block) return NULL;
+
+    if (block->magic != HEAP_MAGIC) {
+        /* Heap corruption */
+        return NULL;
+    }
+
+    remove_free_block(block);
+    return block;
+}
+
+/* Back [start, end) of the heap window with fresh frames (the heap is only
+ * accessed through its window, so high memory is fine) */
+static int heap_map_pages(uint32_t start, uint32_t end) {
+    return vmm_alloc_range(start, end - start, PAGE_PRESENT | PAGE_WRITE | PAGE_GLOBAL);
+}
+
+/* Release [start, end) of the heap window back to the frame allocator */
+static void heap_unmap_pages(uint32_t start, uint32_t end) {
+    vmm_unmap_range(start, end - start);
+}
+
+/* Grow the heap so a free block of at least size bytes exists at the top */
+static int heap_grow(uint32_t size) {
+    uint32_t old_end = (uint32_t)heap_start + heap_size;
+
+    /* Room for the request after class rounding, plus the new sentinel */
+    uint32_t needed = size + (size >> HEAP_SL_LOG2) + BLOCK_OVERHEAD;
+    uint32_t grow = needed > heap_growth_chunk ? needed : heap_growth_chunk;
+    grow = align_up(grow, PAGE_SIZE);
+
+    if (old_end + grow > KHEAP_END || old_end + grow < old_end) {
+        /* Heap window exhausted */
+        return -1;
+    }
+
+    if (heap_map_pages(old_end, old_end + grow) < 0) {
+        return -1;
+    }
+
+    /* The old sentinel becomes the header of the new free block */
+    heap_block_t* block = ptr_to_block((void*)old_end);
+    block->magic = HEAP_MAGIC;
+    block->size = (grow - BLOCK_OVERHEAD) | BLOCK_FREE;
+
+    heap_block_t* sentinel = block_next(block);
+    sentinel->prev_phys = block;
+    sentinel->magic = HEAP_MAGIC;
+    sentinel->size = 0;
+
+    heap_size += grow;
+    if (heap_size > heap_high_water) {
+        heap_high_water = heap_size;
+    }
+
+    /* Merge with a free block that was previously at the top */
+    heap_block_t* prev = block->prev_phys;
+    if (prev && block_is_free(prev)) {
+        remove_free_block(prev);
+        prev->size += block_size(block) + BLOCK_OVERHEAD;
+        block->magic = 0;
+        block = prev;
+        sentinel->prev_phys = block;
+    }
+
+    insert_free_block(block);
+    return 0;
+}
+
+/* Give whole pages back if a large free block sits at the top of the heap */
+static void heap_trim(heap_block_t* block) {
+    if (block_size(block_next(block)) != 0) return;   /* Not the top block */
+
+    uint32_t old_end = (uint32_t)heap_start + heap_size;
+    uint32_t payload = (uint32_t)block_to_ptr(block);
+
+    /* Keep one growth chunk of slack to avoid thrashing, never go below
+     * the boot-time size */
+    uint32_t new_end = align_up(payload + heap_growth_chunk + BLOCK_OVERHEAD, PAGE_SIZE);
+    uint32_t min_end = (uint32_t)heap_start + HEAP_INITIAL_SIZE;
+    if (new_end < min_end) {
+        new_end = min_end;
+    }
+
+    if (new_end >= old_end || old_end - new_end < heap_growth_chunk) {
+        return;
+    }
+
+    remove_free_block(block);
+    block->size = (new_end - BLOCK_OVERHEAD - payload) | BLOCK_FREE;
+
+    heap_block_t* sentinel = block_next(block);
+    sentinel->prev_phys = block;
+    sentinel->magic = HEAP_MAGIC;
+    sentinel->size = 0;
+
+    insert_free_block(block);
+
+    heap_unmap_pages(new_end, old_end);
+    heap_size -= old_end - new_end;
+}
+
+/* Initialize heap (requires the VMM) */
+void heap_init(void) {
+    heap_start = (uint8_t*)KHEAP_START;
+    heap_size = HEAP_INITIAL_SIZE;
+    heap_high_water = heap_size;
+
+    fl_bitmap = 0;
+    for (int i = 0; i < HEAP_FL_COUNT; i++) {
+        sl_bitmap[i] = 0;
+        for (int j = 0; j < HEAP_SL_COUNT; j++) {
+            free_lists[i][j] = NULL;
         }
-        
-        current = current->next;
     }
-    
-    /* No suitable block found - expand heap */
+    heap_used_bytes = 0;
+    heap_free_bytes = 0;
+
+    if (heap_map_pages(KHEAP_START, KHEAP_START + heap_size) < 0) {
+        heap_size = 0;
+        return;
+    }
+
+    /* One free block spanning the heap, followed by a used zero-size
+     * sentinel so block_next() never walks off the end */
+    heap_block_t* first = (heap_block_t*)heap_start;
+    first->prev_phys = NULL;
+    first->magic = HEAP_MAGIC;
+    first->size = (heap_size - 2 * BLOCK_OVERHEAD) | BLOCK_FREE;
+
+    heap_block_t* sentinel = block_next(first);
+    sentinel->prev_phys = first;
+    sentinel->magic = HEAP_MAGIC;
+    sentinel->size = 0;
+
+    insert_free_block(first);
+}
+
+/* Carve an allocation of size bytes for caller */
+static void* heap_alloc(size_t size, uint32_t caller) {
+    uint32_t adjusted = adjust_request(size);
+    if (!adjusted) return NULL;
+
+    heap_block_t* block = locate_free_block(adjusted);
+    if (!block) {
+        /* Expand heap and retry */
+        if (heap_grow(adjusted) < 0) return NULL;
+        block = locate_free_block(adjusted);
+        if (!block) return NULL;
+    }
+
+    block_trim(block, adjusted);
+    PROFILE_TAG(block, caller);
+    return block_mark_used(block);
+}
+
+/* Carve an aligned allocation (alignment a power of two above HEAP_ALIGN) */
+static void* heap_alloc_aligned(size_t size, uint32_t alignment, uint32_t caller) {
+    uint32_t adjusted = adjust_request(size);
+    if (!adjusted) return NULL;
+
+    /* Worst case we need room to split off a leading gap block */
+    uint32_t gap_min = BLOCK_OVERHEAD + BLOCK_SIZE_MIN;
+    uint32_t search = adjusted + alignment + gap_min;
+    heap_block_t* block = locate_free_block(search);
+    if (!block) {
+        if (heap_grow(search) < 0) return NULL;
+        block = locate_free_block(search);
+        if (!block) return NULL;
+    }
+
+    uint32_t ptr = (uint32_t)block_to_ptr(block);
+    uint32_t aligned = align_up(ptr, alignment);
+    uint32_t gap = aligned - ptr;
+
+    /* Gap too small to hold a free block - move to the next boundary */
+    if (gap && gap < gap_min) {
+        aligned = align_up(ptr + gap_min, alignment);
+        gap = aligned - ptr;
+    }
+
+    if (gap) {
+        /* Split off the leading gap as its own free block */
+        heap_block_t* aligned_block = ptr_to_block((void*)aligned);
+        aligned_block->magic = HEAP_MAGIC;
+        aligned_block->size = block_size(block) - gap;
+        aligned_block->prev_phys = block;
+        block_next(aligned_block)->prev_phys = aligned_block;
+
+        block->size = (gap - BLOCK_OVERHEAD) | BLOCK_FREE;
+        insert_free_block(block);
+
+        block = aligned_block;
+    }
+
+    block_trim(block, adjusted);
+    PROFILE_TAG(block, caller);
+    return block_mark_used(block);
+}
+
+#ifdef HEAP_PROFILE
+/* Report an allocation failure with the culprit's address */
+static void* heap_alloc_failed(size_t size, uint32_t caller) {
+    if (size == 0) return NULL;
+    kprintf("[HEAP] kmalloc(%u) failed, caller 0x%x, used %u of %u bytes\n",
+            (uint32_t)size, caller, heap_used_bytes, heap_size);
     return NULL;
 }
+#define HEAP_CHECK(ptr, size, caller) ((ptr) ? (ptr) : heap_alloc_failed(size, caller))
+#else
+#define HEAP_CHECK(ptr, size, caller) (ptr)
+#endif
 
-/* Allocate aligned memory */
+/* Allocate memory */
+void* kmalloc(size_t size) {
+    uint32_t caller = (uint32_t)__builtin_return_address(0);
+    void* ptr = heap_alloc(size, caller);
+    return HEAP_CHECK(ptr, size, caller);
+}
+
+/* Allocate aligned memory (alignment must be a power of two) */
 void* kmalloc_aligned(size_t size, uint32_t alignment) {
-    /* Simple implementation - allocate extra and align */
-    void* ptr = kmalloc(size + alignment);
-    if (!ptr) return NULL;
-    
-    uint32_t addr = (uint32_t)ptr;
-    uint32_t aligned_addr = (addr + alignment - 1) & ~(alignment - 1);
-    
-    return (void*)aligned_addr;
+    uint32_t caller = (uint32_t)__builtin_return_address(0);
+    void* ptr = alignment <= HEAP_ALIGN ? heap_alloc(size, caller)
+                                        : heap_alloc_aligned(size, alignment, caller);
+    return HEAP_CHECK(ptr, size, caller);
 }
 
 /* Free memory */
 void kfree(void* ptr) {
     if (!ptr) return;
-    
-    heap_block_t* block = (heap_block_t*)((uint8_t*)ptr - sizeof(heap_block_t));
-    
-    if (block->magic != HEAP_MAGIC) {
-        /* Invalid pointer */
+
+    heap_block_t* block = ptr_to_block(ptr);
+
+    if (block->magic != HEAP_MAGIC || block_is_free(block)) {
+        /* Invalid pointer or double free */
         return;
     }
-    
-    block->is_free = 1;
-    
+
+    PROFILE_UNTAG(block);
+    heap_used_bytes -= block_size(block) + BLOCK_OVERHEAD;
+    block->size |= BLOCK_FREE;
+
+    /* Coalesce with previous block if free */
+    heap_block_t* prev = block->prev_phys;
+    if (prev && block_is_free(prev)) {
+        remove_free_block(prev);
+        prev->size += block_size(block) + BLOCK_OVERHEAD;
+        block->magic = 0;
+        block = prev;
+        block_next(block)->prev_phys = block;
+    }
+
     /* Coalesce with next block if free */
-    if (block->next && block->next->is_free) {
-        block->size += sizeof(heap_block_t) + block->next->size;
-        block->next = block->next->next;
+    heap_block_t* next = block_next(block);
+    if (block_is_free(next)) {
+        remove_free_block(next);
+        block->size += block_size(next) + BLOCK_OVERHEAD;
+        next->magic = 0;
+        block_next(block)->prev_phys = block;
     }
-    
-    /* TODO: Coalesce with previous block */
+
+    insert_free_block(block);
+    heap_trim(block);
 }
 
 /* Get heap statistics */
 uint32_t heap_get_used(void) {
-    uint32_t used = 0;
-    heap_block_t* current = heap_start;
-    
-    while (current) {
-        if (!current->is_free) {
-            used += current->size + sizeof(heap_block_t);
+    return heap_used_bytes;
+}
+
+uint32_t heap_get_free(void) {
+    return heap_free_bytes;
+}
+
+uint32_t heap_get_size(void) {
+    return heap_size;
+}
+
+uint32_t heap_get_high_water(void) {
+    return heap_high_water;
+}
+
+/* Tune how much the heap grows by when it runs out */
+void heap_set_growth_chunk(uint32_t bytes) {
+    if (bytes < PAGE_SIZE) bytes = PAGE_SIZE;
+    heap_growth_chunk = align_up(bytes, PAGE_SIZE);
+}
+
+uint32_t heap_get_growth_chunk(void) {
+    return heap_growth_chunk;
+}
+
+/* Bucket free blocks by power-of-two size: bucket i counts blocks of
+ * [2^i, 2^(i+1)) bytes, the last bucket everything larger */
+void heap_get_free_histogram(uint32_t* counts, uint32_t buckets, uint32_t* largest) {
+    for (uint32_t i = 0; i < buckets; i++) {
+        counts[i] = 0;
+    }
+    *largest = 0;
+
+    for (int fl = 0; fl < HEAP_FL_COUNT; fl++) {
+        if (!(fl_bitmap & (1U << fl))) continue;
+        for (int sl = 0; sl < HEAP_SL_COUNT; sl++) {
+            for (heap_block_t* b = free_lists[fl][sl]; b; b = b->next_free) {
+                uint32_t size = block_size(b);
+                uint32_t bucket = heap_fls(size);
+                if (bucket >= buckets) bucket = buckets - 1;
+                counts[bucket]++;
+                if (size > *largest) *largest = size;
+            }
         }
-        current = current->next;
     }
-    
-    return used;
 }
 
-uint32_t heap_get_free(void) {
-    uint32_t free = 0;
-    heap_block_t* current = heap_start;
-    
-    while (current) {
-        if (current->is_free) {
-            free += current->size;
+#ifdef HEAP_PROFILE
+/* Copy up to max call sites into out, largest live footprint first */
+uint32_t heap_profile_sites(heap_site_info_t* out, uint32_t max) {
+    uint32_t count = 0;
+
+    for (int i = 0; i < HEAP_PROFILE_SITES; i++) {
+        const heap_site_info_t* site = &site_table[i];
+        if (!site->allocs) continue;
+
+        /* Insertion into the sorted output, dropping the smallest */
+        uint32_t pos = count;
+        while (pos > 0 && out[pos - 1].live_bytes < site->live_bytes) {
+            if (pos < max) out[pos] = out[pos - 1];
+            pos--;
+        }
+        if (pos < max) {
+            out[pos] = *site;
+            if (count < max) count++;
         }
-        current = current->next;
     }
-    
-    return free;
-}
\ No newline at end of file
+    return count;
+}
+
+/* Live blocks per first-level size class */
+uint32_t heap_profile_class_live(uint32_t size_class) {
+    return size_class < HEAP_FL_COUNT ? class_live[size_class] : 0;
+}
+
+/* Smallest payload that falls in a first-level size class */
+uint32_t heap_profile_class_base(uint32_t size_class) {
+    return size_class ? 1U << (size_class + HEAP_FL_SHIFT - 1) : 0;
+}
+
+uint32_t heap_profile_class_count(void) {
+    return HEAP_FL_COUNT;
+}
+#else
+uint32_t heap_profile_sites(heap_site_info_t* out, uint32_t max) {
+    (void)out;
+    (void)max;
+    return 0;
+}
+#endif
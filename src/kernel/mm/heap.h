@@ -6,7 +6,7 @@
 #include <stdint.h>
 #include <stddef.h>
 
-/* Initialize heap */
+/* Initialize heap (call after vmm_init) */
 void heap_init(void);
 
 /* Allocate memory from heap */
@@ -21,5 +21,35 @@ void kfree(void* ptr);
 /* Get heap statistics */
 uint32_t heap_get_used(void);
 uint32_t heap_get_free(void);
+uint32_t heap_get_size(void);           /* Bytes currently mapped */
+uint32_t heap_get_high_water(void);     /* Peak mapped size */
+
+/* Heap growth step (rounded up to whole pages) */
+void heap_set_growth_chunk(uint32_t bytes);
+uint32_t heap_get_growth_chunk(void);
+
+/* Free-block size histogram: counts[i] is the number of free blocks of
+ * [2^i, 2^(i+1)) bytes (the last bucket takes everything larger) */
+void heap_get_free_histogram(uint32_t* counts, uint32_t buckets, uint32_t* largest);
+
+/* Per call-site allocation counters (kernel built with HEAP_PROFILE=1) */
+typedef struct {
+    uint32_t caller;                    /* Return address of kmalloc call, 0 = other */
+    uint32_t live_bytes;
+    uint32_t live_blocks;
+    uint32_t peak_bytes;                /* Highest live_bytes seen */
+    uint32_t allocs;                    /* Allocations ever made */
+} heap_site_info_t;
+
+/* Copy up to max sites, largest live footprint first; returns the count
+ * (always 0 without HEAP_PROFILE) */
+uint32_t heap_profile_sites(heap_site_info_t* out, uint32_t max);
+
+#ifdef HEAP_PROFILE
+/* Live blocks by first-level size class */
+uint32_t heap_profile_class_count(void);
+uint32_t heap_profile_class_base(uint32_t size_class);
+uint32_t heap_profile_class_live(uint32_t size_class);
+#endif
 
 #endif /* HEAP_H */
\ No newline at end of file
@@ -1,39 +1,212 @@
-/* memory.c - Simple memory management with bump allocator */
+/* memory.c - Boot memory map, reserved ranges and early bump allocator
+ *
+ * memory_init() turns the multiboot memory map into a sorted list of usable
+ * RAM regions (in page frames, clipped to 4GB, 16GB with PAE) and records the ranges that
+ * must never be handed out: the first 1MB, the kernel image, the multiboot
+ * info and boot modules. kmalloc_early() hands out memory just past all of
+ * these until pmm_init() has built the frame allocator.
+ */
 
 #include "memory.h"
+#include "pmm.h"
+#include "../core/console.h"
+
+#define PAGE_SHIFT 12
+#ifdef CONFIG_PAE
+#define PFN_LIMIT  0x400000    /* 16GB: bounds the frame descriptor array */
+#else
+#define PFN_LIMIT  0x100000    /* 4GB in 4KB frames (no PAE) */
+#endif
 
 /* External symbols from linker script */
+extern uint32_t kernel_start;
 extern uint32_t kernel_end;
 
+/* Usable RAM and reserved ranges */
+static memory_range_t regions[MEMORY_MAX_REGIONS];
+static uint32_t region_count = 0;
+static memory_range_t reserved[MEMORY_MAX_RESERVED];
+static uint32_t reserved_count = 0;
+static uint32_t max_pfn = 0;
+
 /* Memory tracking */
-static uint32_t total_memory = 0;      /* Total memory in bytes */
-static uint32_t heap_start = 0;        /* Start of heap */
-static uint32_t heap_current = 0;      /* Current heap position */
-
-void memory_init(uint32_t total_kb) {
-    total_memory = total_kb * 1024;
-    
-    /* Align heap start to 4KB boundary after kernel */
-    heap_start = ((uint32_t)&kernel_end + 0xFFF) & ~0xFFF;
+static uint32_t total_pages = 0;       /* Usable memory in frames */
+static uint32_t heap_start = 0;        /* Start of early allocations */
+static uint32_t heap_current = 0;      /* Current early allocation position */
+static int early_done = 0;
+
+/* Add usable RAM range from the memory map */
+static void add_region(uint64_t addr, uint64_t len) {
+    uint64_t start = (addr + 0xFFF) >> PAGE_SHIFT;
+    uint64_t end = (addr + len) >> PAGE_SHIFT;
+
+    if (end > PFN_LIMIT) end = PFN_LIMIT;
+    if (start >= end) return;
+
+    if (region_count >= MEMORY_MAX_REGIONS) {
+        kprintf("[MEM] Too many memory regions, ignoring 0x%x\n", (uint32_t)addr);
+        return;
+    }
+
+    /* Insert sorted by start */
+    uint32_t i = region_count;
+    while (i > 0 && regions[i - 1].start_pfn > (uint32_t)start) {
+        regions[i] = regions[i - 1];
+        i--;
+    }
+    regions[i].start_pfn = (uint32_t)start;
+    regions[i].end_pfn = (uint32_t)end;
+    region_count++;
+}
+
+/* Merge overlapping or adjacent regions */
+static void merge_regions(void) {
+    if (region_count == 0) return;
+
+    uint32_t out = 0;
+    for (uint32_t i = 1; i < region_count; i++) {
+        if (regions[i].start_pfn <= regions[out].end_pfn) {
+            if (regions[i].end_pfn > regions[out].end_pfn) {
+                regions[out].end_pfn = regions[i].end_pfn;
+            }
+        } else {
+            regions[++out] = regions[i];
+        }
+    }
+    region_count = out + 1;
+}
+
+void memory_init(struct multiboot_info* mboot) {
+    region_count = 0;
+    reserved_count = 0;
+
+    /* Collect usable RAM */
+    if (mboot->flags & MULTIBOOT_INFO_MMAP) {
+        uint32_t addr = mboot->mmap_addr;
+        uint32_t end = mboot->mmap_addr + mboot->mmap_length;
+
+        while (addr < end) {
+            struct multiboot_mmap_entry* entry = (struct multiboot_mmap_entry*)addr;
+            if (entry->type == MULTIBOOT_MEMORY_AVAILABLE) {
+                add_region(entry->addr, entry->len);
+            }
+            addr += entry->size + sizeof(entry->size);
+        }
+    } else if (mboot->flags & MULTIBOOT_INFO_MEMORY) {
+        add_region(0, (uint64_t)mboot->mem_lower * 1024);
+        add_region(0x100000, (uint64_t)mboot->mem_upper * 1024);
+    }
+
+    merge_regions();
+
+    total_pages = 0;
+    max_pfn = 0;
+    for (uint32_t i = 0; i < region_count; i++) {
+        total_pages += regions[i].end_pfn - regions[i].start_pfn;
+        max_pfn = regions[i].end_pfn;
+    }
+
+    /* Reserve BIOS area, kernel image and boot information */
+    memory_reserve(0, 0x100000);
+    memory_reserve((uint32_t)&kernel_start, (uint32_t)&kernel_end);
+    memory_reserve((uint32_t)mboot, (uint32_t)mboot + sizeof(struct multiboot_info));
+
+    if (mboot->flags & MULTIBOOT_INFO_MODS) {
+        struct multiboot_module* mods = (struct multiboot_module*)mboot->mods_addr;
+        memory_reserve(mboot->mods_addr,
+                       mboot->mods_addr + mboot->mods_count * sizeof(struct multiboot_module));
+        for (uint32_t i = 0; i < mboot->mods_count; i++) {
+            memory_reserve(mods[i].mod_start, mods[i].mod_end);
+        }
+    }
+
+    /* Early allocations start past everything reserved so far */
+    uint32_t start_pfn = 0;
+    for (uint32_t i = 0; i < reserved_count; i++) {
+        if (reserved[i].end_pfn > start_pfn) {
+            start_pfn = reserved[i].end_pfn;
+        }
+    }
+    heap_start = start_pfn << PAGE_SHIFT;
     heap_current = heap_start;
+    early_done = 0;
+
+    kprintf("[MEM] %u regions, %u KB usable, early allocations at 0x%x\n",
+            region_count, total_pages * (PMM_PAGE_SIZE / 1024), heap_start);
+}
+
+/* Early bump allocator */
+void* kmalloc_early(size_t size) {
+    if (early_done) return NULL;
+
+    heap_current = (heap_current + 15) & ~15;
+    void* ptr = (void*)heap_current;
+    heap_current += size;
+
+    return ptr;
+}
+
+/* Freeze early allocations so the frame allocator skips them */
+void memory_end_early(void) {
+    if (early_done) return;
+
+    memory_reserve(heap_start, heap_current);
+    early_done = 1;
+}
+
+/* Reserve physical byte range [start, end) */
+void memory_reserve(uint32_t start, uint32_t end) {
+    if (end <= start) return;
+
+    if (reserved_count >= MEMORY_MAX_RESERVED) {
+        kprintf("[MEM] Too many reserved ranges, dropping 0x%x\n", start);
+        return;
+    }
+
+    reserved[reserved_count].start_pfn = start >> PAGE_SHIFT;
+    reserved[reserved_count].end_pfn = (end >> PAGE_SHIFT) + ((end & 0xFFF) ? 1 : 0);
+    reserved_count++;
+}
+
+uint32_t memory_get_region_count(void) {
+    return region_count;
+}
+
+const memory_range_t* memory_get_region(uint32_t index) {
+    if (index >= region_count) return NULL;
+    return &regions[index];
+}
+
+uint32_t memory_get_reserved_count(void) {
+    return reserved_count;
+}
+
+const memory_range_t* memory_get_reserved(uint32_t index) {
+    if (index >= reserved_count) return NULL;
+    return &reserved[index];
+}
+
+uint32_t memory_get_max_pfn(void) {
+    return max_pfn;
 }
 
 uint32_t memory_get_total(void) {
-    return total_memory;
+    return total_pages * (PMM_PAGE_SIZE / 1024);
 }
 
 uint32_t memory_get_used(void) {
-    return heap_current - heap_start;
+    uint32_t total = memory_get_total();
+    uint32_t free = memory_get_free();
+    if (total > free) {
+        return total - free;
+    }
+    return 0;
 }
 
 uint32_t memory_get_free(void) {
-    uint32_t used = heap_current - heap_start;
-    if (total_memory > used) {
-        return total_memory - used;
-    }
-    return 0;
+    return pmm_get_free_pages(PMM_ZONE_ALL) * (PMM_PAGE_SIZE / 1024);
 }
 
 uint32_t memory_get_heap_start(void) {
     return heap_start;
-}
\ No newline at end of file
+}
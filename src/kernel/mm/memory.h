@@ -5,14 +5,41 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "../core/multiboot.h"
+
+#define MEMORY_MAX_REGIONS  32
+#define MEMORY_MAX_RESERVED 32
+
+/* Physical range in page frame numbers, end exclusive */
+typedef struct {
+    uint32_t start_pfn;
+    uint32_t end_pfn;
+} memory_range_t;
 
 /* Initialize memory subsystem with multiboot info */
-void memory_init(uint32_t total_kb);
+void memory_init(struct multiboot_info* mboot);
 
-/* Simple bump allocator (for early allocation) */
+/* Simple bump allocator (for early allocation, before pmm_init) */
 void* kmalloc_early(size_t size);
 
-/* Get memory statistics */
+/* Stop early allocation and reserve everything it handed out */
+void memory_end_early(void);
+
+/* Mark a physical byte range as not usable by the frame allocator */
+void memory_reserve(uint32_t start, uint32_t end);
+
+/* Usable RAM regions from the boot memory map (below 4GB, 16GB with PAE) */
+uint32_t memory_get_region_count(void);
+const memory_range_t* memory_get_region(uint32_t index);
+
+/* Reserved ranges (kernel image, boot modules, early allocations) */
+uint32_t memory_get_reserved_count(void);
+const memory_range_t* memory_get_reserved(uint32_t index);
+
+/* Highest usable page frame number + 1 */
+uint32_t memory_get_max_pfn(void);
+
+/* Get memory statistics in KB (bytes would overflow past 4GB) */
 uint32_t memory_get_total(void);
 uint32_t memory_get_used(void);
 uint32_t memory_get_free(void);
@@ -20,4 +47,4 @@ uint32_t memory_get_free(void);
 /* Get heap start address */
 uint32_t memory_get_heap_start(void);
 
-#endif /* MEMORY_H */
\ No newline at end of file
+#endif /* MEMORY_H */
@@ -0,0 +1,309 @@
+/* pmm.c - Physical memory manager (buddy allocator)
+ *
+ * Physical memory is split into zones: the low zone is direct-mapped by
+ * the kernel (below LOWMEM_END), the high zone holds everything above it
+ * and is only accessed through temporary mappings. Each zone keeps one
+ * free list per block order; a block of order n is 2^n pages, aligned to
+ * its own size. Allocation splits the smallest sufficient block, freeing
+ * merges a block with its buddy (pfn ^ 2^n) for as long as the buddy is
+ * also free, so both are O(PMM_MAX_ORDER) regardless of memory size.
+ *
+ * Per-frame state lives in a descriptor array sized to the highest usable
+ * frame, allocated with kmalloc_early() before the allocator goes live.
+ * Allocated blocks carry a reference count so copy-on-write mappings can
+ * share a frame; freeing only returns the block once the count drops to 0.
+ */
+
+#include "pmm.h"
+#include "memory.h"
+#include "vmm.h"
+#include "../core/console.h"
+
+#define PFN_NONE        0xFFFFFFFF
+
+/* Frame descriptor flags */
+#define FRAME_FREE      0x01        /* Head of a free block */
+#define FRAME_RESERVED  0x02        /* Hole or reserved: never allocated */
+
+/* Per-frame descriptor */
+typedef struct {
+    uint32_t next;                  /* Free list links (pfn) */
+    uint32_t prev;
+    uint8_t order;                  /* Block order (free or allocated head) */
+    uint8_t flags;
+    uint16_t refcount;              /* Mappings sharing an allocated block */
+} frame_t;
+
+/* Memory zone */
+typedef struct {
+    const char* name;
+    uint32_t start_pfn;
+    uint32_t end_pfn;
+    uint32_t free_head[PMM_MAX_ORDER + 1];
+    uint32_t free_blocks[PMM_MAX_ORDER + 1];
+    uint32_t free_pages;
+    uint32_t total_pages;
+} zone_t;
+
+static frame_t* frames = NULL;
+static uint32_t frame_count = 0;
+static zone_t zones[PMM_ZONE_COUNT];
+
+/* Free list helpers */
+static void free_list_push(zone_t* zone, uint32_t pfn, uint32_t order) {
+    frame_t* frame = &frames[pfn];
+
+    frame->flags |= FRAME_FREE;
+    frame->order = order;
+    frame->prev = PFN_NONE;
+    frame->next = zone->free_head[order];
+    if (frame->next != PFN_NONE) {
+        frames[frame->next].prev = pfn;
+    }
+    zone->free_head[order] = pfn;
+    zone->free_blocks[order]++;
+}
+
+static void free_list_remove(zone_t* zone, uint32_t pfn, uint32_t order) {
+    frame_t* frame = &frames[pfn];
+
+    if (frame->prev != PFN_NONE) {
+        frames[frame->prev].next = frame->next;
+    } else {
+        zone->free_head[order] = frame->next;
+    }
+    if (frame->next != PFN_NONE) {
+        frames[frame->next].prev = frame->prev;
+    }
+    frame->flags &= ~FRAME_FREE;
+    zone->free_blocks[order]--;
+}
+
+/* Find zone owning pfn */
+static zone_t* pfn_to_zone(uint32_t pfn) {
+    for (int i = 0; i < PMM_ZONE_COUNT; i++) {
+        if (pfn >= zones[i].start_pfn && pfn < zones[i].end_pfn) {
+            return &zones[i];
+        }
+    }
+    return NULL;
+}
+
+/* Return block to its zone, merging with free buddies */
+static void buddy_free(zone_t* zone, uint32_t pfn, uint32_t order) {
+    zone->free_pages += 1 << order;
+
+    while (order < PMM_MAX_ORDER) {
+        uint32_t buddy = pfn ^ (1 << order);
+
+        if (buddy < zone->start_pfn || buddy + (1 << order) > zone->end_pfn) break;
+        if (!(frames[buddy].flags & FRAME_FREE) || frames[buddy].order != order) break;
+
+        free_list_remove(zone, buddy, order);
+        pfn &= buddy;
+        order++;
+    }
+
+    free_list_push(zone, pfn, order);
+}
+
+/* Take a block of the given order from zone, splitting larger blocks */
+static uint32_t buddy_alloc(zone_t* zone, uint32_t order) {
+    uint32_t current = order;
+    while (current <= PMM_MAX_ORDER && zone->free_head[current] == PFN_NONE) {
+        current++;
+    }
+    if (current > PMM_MAX_ORDER) return PFN_NONE;
+
+    uint32_t pfn = zone->free_head[current];
+    free_list_remove(zone, pfn, current);
+
+    /* Give back the upper halves */
+    while (current > order) {
+        current--;
+        free_list_push(zone, pfn + (1 << current), current);
+    }
+
+    frames[pfn].order = order;
+    frames[pfn].refcount = 1;
+    zone->free_pages -= 1 << order;
+
+    return pfn;
+}
+
+/* Hand [start, end) to the allocator in the largest aligned blocks */
+static void release_pages(uint32_t start, uint32_t end) {
+    while (start < end) {
+        uint32_t order = 0;
+        while (order < PMM_MAX_ORDER &&
+               (start & ((2u << order) - 1)) == 0 &&
+               start + (2u << order) <= end) {
+            order++;
+        }
+
+        zone_t* zone = pfn_to_zone(start);
+        for (uint32_t pfn = start; pfn < start + (1 << order); pfn++) {
+            frames[pfn].flags &= ~FRAME_RESERVED;
+        }
+        zone->total_pages += 1 << order;
+        buddy_free(zone, start, order);
+
+        start += 1 << order;
+    }
+}
+
+/* Release a usable range, skipping reserved ranges from index 'first' on */
+static void release_range(uint32_t start, uint32_t end, uint32_t first) {
+    if (start >= end) return;
+
+    for (uint32_t i = first; i < memory_get_reserved_count(); i++) {
+        const memory_range_t* r = memory_get_reserved(i);
+        if (r->start_pfn < end && r->end_pfn > start) {
+            release_range(start, r->start_pfn, i + 1);
+            release_range(r->end_pfn, end, i + 1);
+            return;
+        }
+    }
+
+    /* Blocks never straddle the zone boundary */
+    uint32_t boundary = zones[PMM_ZONE_LOW].end_pfn;
+    if (start < boundary && end > boundary) {
+        release_pages(start, boundary);
+        release_pages(boundary, end);
+    } else {
+        release_pages(start, end);
+    }
+}
+
+/* Initialize physical memory manager */
+void pmm_init(void) {
+    kprintf("[PMM] Initializing buddy allocator...\n");
+
+    frame_count = memory_get_max_pfn();
+    frames = (frame_t*)kmalloc_early(frame_count * sizeof(frame_t));
+    memory_end_early();
+
+    for (uint32_t pfn = 0; pfn < frame_count; pfn++) {
+        frames[pfn].next = PFN_NONE;
+        frames[pfn].prev = PFN_NONE;
+        frames[pfn].order = 0;
+        frames[pfn].flags = FRAME_RESERVED;
+        frames[pfn].refcount = 0;
+    }
+
+    uint32_t lowmem_pfn = LOWMEM_END / PMM_PAGE_SIZE;
+
+    zones[PMM_ZONE_LOW].name = "Low";
+    zones[PMM_ZONE_LOW].start_pfn = 0;
+    zones[PMM_ZONE_LOW].end_pfn = frame_count < lowmem_pfn ? frame_count : lowmem_pfn;
+    zones[PMM_ZONE_HIGH].name = "High";
+    zones[PMM_ZONE_HIGH].start_pfn = zones[PMM_ZONE_LOW].end_pfn;
+    zones[PMM_ZONE_HIGH].end_pfn = frame_count;
+
+    for (int z = 0; z < PMM_ZONE_COUNT; z++) {
+        for (int o = 0; o <= PMM_MAX_ORDER; o++) {
+            zones[z].free_head[o] = PFN_NONE;
+            zones[z].free_blocks[o] = 0;
+        }
+        zones[z].free_pages = 0;
+        zones[z].total_pages = 0;
+    }
+
+    for (uint32_t i = 0; i < memory_get_region_count(); i++) {
+        const memory_range_t* r = memory_get_region(i);
+        release_range(r->start_pfn, r->end_pfn, 0);
+    }
+
+    for (int z = 0; z < PMM_ZONE_COUNT; z++) {
+        kprintf("[PMM] %s zone: %u pages free of %u\n",
+                zones[z].name, zones[z].free_pages, zones[z].total_pages);
+    }
+}
+
+/* Allocate 2^order contiguous pages */
+phys_addr_t pmm_alloc_pages(uint32_t order, uint32_t flags) {
+    if (order > PMM_MAX_ORDER) return 0;
+
+    uint32_t pfn = PFN_NONE;
+    if (flags & PMM_HIGHMEM) {
+        pfn = buddy_alloc(&zones[PMM_ZONE_HIGH], order);
+    }
+    if (pfn == PFN_NONE) {
+        pfn = buddy_alloc(&zones[PMM_ZONE_LOW], order);
+    }
+    if (pfn == PFN_NONE) return 0;
+
+    return (phys_addr_t)pfn * PMM_PAGE_SIZE;
+}
+
+/* Free 2^order pages */
+void pmm_free_pages(phys_addr_t addr, uint32_t order) {
+    uint32_t pfn = addr / PMM_PAGE_SIZE;
+
+    /* Frames outside managed RAM (identity-mapped holes, MMIO) are ignored */
+    if (pfn >= frame_count || (frames[pfn].flags & FRAME_RESERVED)) return;
+
+    if ((frames[pfn].flags & FRAME_FREE) || frames[pfn].order != order ||
+        (pfn & ((1 << order) - 1))) {
+        kprintf("[PMM] Bad free of frame 0x%x (order %u)\n", pfn, order);
+        return;
+    }
+
+    /* Still shared: just drop this reference */
+    if (frames[pfn].refcount > 1) {
+        frames[pfn].refcount--;
+        return;
+    }
+    frames[pfn].refcount = 0;
+
+    buddy_free(pfn_to_zone(pfn), pfn, order);
+}
+
+/* Add a reference to an allocated block */
+void pmm_ref_frame(phys_addr_t addr) {
+    uint32_t pfn = addr / PMM_PAGE_SIZE;
+    if (pfn >= frame_count || (frames[pfn].flags & (FRAME_RESERVED | FRAME_FREE))) return;
+
+    if (frames[pfn].refcount < 0xFFFF) {
+        frames[pfn].refcount++;
+    }
+}
+
+/* Get reference count of an allocated block (0 if unmanaged or free) */
+uint32_t pmm_get_refcount(phys_addr_t addr) {
+    uint32_t pfn = addr / PMM_PAGE_SIZE;
+    if (pfn >= frame_count || (frames[pfn].flags & (FRAME_RESERVED | FRAME_FREE))) return 0;
+
+    return frames[pfn].refcount;
+}
+
+uint32_t pmm_get_free_pages(int zone) {
+    if (zone == PMM_ZONE_ALL) {
+        return zones[PMM_ZONE_LOW].free_pages + zones[PMM_ZONE_HIGH].free_pages;
+    }
+    if (zone < 0 || zone >= PMM_ZONE_COUNT) return 0;
+    return zones[zone].free_pages;
+}
+
+uint32_t pmm_get_total_pages(int zone) {
+    if (zone == PMM_ZONE_ALL) {
+        return zones[PMM_ZONE_LOW].total_pages + zones[PMM_ZONE_HIGH].total_pages;
+    }
+    if (zone < 0 || zone >= PMM_ZONE_COUNT) return 0;
+    return zones[zone].total_pages;
+}
+
+uint32_t pmm_get_free_blocks(int zone, uint32_t order) {
+    if (zone < 0 || zone >= PMM_ZONE_COUNT || order > PMM_MAX_ORDER) return 0;
+    return zones[zone].free_blocks[order];
+}
+
+/* Allocate a single direct-mapped frame */
+uint32_t alloc_frame(void) {
+    return pmm_alloc_pages(0, PMM_LOWMEM);
+}
+
+/* Drop a reference to a single frame, freeing it with the last one */
+void free_frame(phys_addr_t addr) {
+    pmm_free_pages(addr, 0);
+}
@@ -0,0 +1,54 @@
+/* pmm.h - Physical memory manager (buddy allocator) */
+
+#ifndef PMM_H
+#define PMM_H
+
+#include <stdint.h>
+
+#define PMM_PAGE_SIZE   4096
+#define PMM_MAX_ORDER   10          /* Largest block: 2^10 pages (4MB) */
+
+/* Zones */
+#define PMM_ZONE_LOW    0           /* Direct-mapped, usable by physical address */
+#define PMM_ZONE_HIGH   1           /* Only reachable through vmm_kmap() */
+#define PMM_ZONE_COUNT  2
+#define PMM_ZONE_ALL    -1
+
+/* Allocation flags */
+#define PMM_LOWMEM      0x0         /* Must be direct-mapped */
+#define PMM_HIGHMEM     0x1         /* Prefer high memory, fall back to low */
+
+/* Frames above 4GB exist only with PAE; they are always high zone */
+#ifdef CONFIG_PAE
+typedef uint64_t phys_addr_t;
+#else
+typedef uint32_t phys_addr_t;
+#endif
+
+/* Build the allocator from the boot memory map (after memory_init) */
+void pmm_init(void);
+
+/* Allocate 2^order physically contiguous, naturally aligned pages.
+ * Returns 0 when no block is available. */
+phys_addr_t pmm_alloc_pages(uint32_t order, uint32_t flags);
+
+/* Drop a reference to a block returned by pmm_alloc_pages (same order);
+ * the block is freed when its last reference goes away */
+void pmm_free_pages(phys_addr_t addr, uint32_t order);
+
+/* Reference counting for blocks shared between mappings */
+void pmm_ref_frame(phys_addr_t addr);
+uint32_t pmm_get_refcount(phys_addr_t addr);
+
+/* Statistics (zone is PMM_ZONE_LOW, PMM_ZONE_HIGH or PMM_ZONE_ALL) */
+uint32_t pmm_get_free_pages(int zone);
+uint32_t pmm_get_total_pages(int zone);
+uint32_t pmm_get_free_blocks(int zone, uint32_t order);
+
+/* Allocate a single direct-mapped frame (returns 0 when out of memory) */
+uint32_t alloc_frame(void);
+
+/* Drop a reference to a single frame (of either zone) */
+void free_frame(phys_addr_t addr);
+
+#endif /* PMM_H */
@@ -0,0 +1,408 @@
+/* region.c - Demand-paged user address space regions
+ *
+ * exec() only records what the new image looks like: one region per ELF
+ * segment plus one for the stack. Nothing is mapped until the program
+ * touches a page; the fault handler then takes a pre-zeroed frame from the
+ * zero pool, copies in whatever file data the covering regions have for
+ * that page and maps it. Regions are byte-exact, so two segments may share a boundary
+ * page; such a page is filled from both and gets the union of their
+ * permissions. Pages evicted to swap keep a swap entry in their PTE and
+ * are read back here too, together with the neighbours evicted with them.
+ */
+
+#include "region.h"
+#include "slab.h"
+#include "vmm.h"
+#include "shm.h"
+#include "zpool.h"
+#include "swap.h"
+#include "../fs/vfs.h"
+#include "../core/console.h"
+
+static kmem_cache_t* region_cache = NULL;
+
+/* Initialize region allocator */
+void region_init(void) {
+    region_cache = kmem_cache_create("vm_region", sizeof(vm_region_t), 0, NULL);
+}
+
+/* Free a region, dropping its hold on a shared segment */
+static void region_free(vm_region_t* region) {
+    if (region->shm) {
+        shm_release(region->shm);
+    }
+    kmem_cache_free(region_cache, region);
+}
+
+/* Add region to list, kept sorted by address */
+vm_region_t* region_add(vm_region_t** list, uint32_t start, uint32_t end, uint32_t flags,
+                        struct vfs_node* file, uint32_t file_offset, uint32_t file_size) {
+    if (!list || end <= start) return NULL;
+    if (file_size > end - start) return NULL;
+
+    vm_region_t** link = list;
+    while (*link && (*link)->start < start) {
+        link = &(*link)->next;
+    }
+
+    /* Reject overlap with neighbours */
+    for (vm_region_t* r = *list; r != NULL; r = r->next) {
+        if (r->start < end && r->end > start) {
+            kprintf("[REGION] 0x%x-0x%x overlaps 0x%x-0x%x\n", start, end, r->start, r->end);
+            return NULL;
+        }
+    }
+
+    vm_region_t* region = (vm_region_t*)kmem_cache_alloc(region_cache);
+    if (!region) return NULL;
+
+    region->start = start;
+    region->end = end;
+    region->flags = flags;
+    region->file = file;
+    region->file_offset = file_offset;
+    region->file_size = file ? file_size : 0;
+    region->shm = NULL;
+    region->next = *link;
+    *link = region;
+
+    return region;
+}
+
+/* Find region containing address */
+vm_region_t* region_find(vm_region_t* list, uint32_t addr) {
+    for (vm_region_t* r = list; r != NULL; r = r->next) {
+        if (addr >= r->start && addr < r->end) {
+            return r;
+        }
+    }
+    return NULL;
+}
+
+/* Move the end of a region, failing if it would run into a neighbour */
+int region_resize(vm_region_t* list, vm_region_t* region, uint32_t new_end) {
+    if (new_end <= region->start) return -1;
+    if (new_end < region->start + region->file_size) return -1;
+    
+    for (vm_region_t* r = list; r != NULL; r = r->next) {
+        if (r != region && r->start < new_end && r->end > region->start) {
+            return -1;
+        }
+    }
+    
+    region->end = new_end;
+    return 0;
+}
+
+/* Unlink and free a single region */
+void region_remove(vm_region_t** list, vm_region_t* region) {
+    for (vm_region_t** link = list; *link != NULL; link = &(*link)->next) {
+        if (*link == region) {
+            *link = region->next;
+            region_free(region);
+            return;
+        }
+    }
+}
+
+/* Split a region at addr (start < addr < end); returns the upper half */
+static vm_region_t* region_split(vm_region_t* region, uint32_t addr) {
+    vm_region_t* upper = (vm_region_t*)kmem_cache_alloc(region_cache);
+    if (!upper) return NULL;
+    
+    *upper = *region;
+    upper->start = addr;
+    upper->file_offset = region->file_offset + (addr - region->start);
+    upper->file_size = 0;
+    if (region->file_size > addr - region->start) {
+        upper->file_size = region->file_size - (addr - region->start);
+        region->file_size = addr - region->start;
+    }
+    
+    if (upper->shm) {
+        shm_hold(upper->shm);
+    }
+    
+    region->end = addr;
+    region->next = upper;
+    return upper;
+}
+
+/* Make sure no region straddles start or end */
+static int region_split_range(vm_region_t* list, uint32_t start, uint32_t end) {
+    for (vm_region_t* r = list; r != NULL; r = r->next) {
+        if (r->start < start && r->end > start) {
+            if (!region_split(r, start)) return -1;
+        } else if (r->start < end && r->end > end) {
+            if (!region_split(r, end)) return -1;
+        }
+    }
+    return 0;
+}
+
+/* Remove [start, end) from the list, trimming regions at the edges */
+int region_unmap(vm_region_t** list, uint32_t start, uint32_t end) {
+    if (region_split_range(*list, start, end) < 0) return -1;
+    
+    vm_region_t** link = list;
+    while (*link) {
+        vm_region_t* r = *link;
+        if (r->start >= start && r->end <= end) {
+            *link = r->next;
+            region_free(r);
+        } else {
+            link = &r->next;
+        }
+    }
+    return 0;
+}
+
+/* Change the flags of [start, end), which must be fully covered */
+int region_protect(vm_region_t* list, uint32_t start, uint32_t end, uint32_t flags) {
+    /* Regions are sorted, so coverage means no holes from start to end */
+    uint32_t covered = start;
+    for (vm_region_t* r = list; r != NULL && covered < end; r = r->next) {
+        if (r->end <= covered) continue;
+        if (r->start > covered) return -1;
+        covered = r->end;
+    }
+    if (covered < end) return -1;
+    
+    if (region_split_range(list, start, end) < 0) return -1;
+    
+    for (vm_region_t* r = list; r != NULL; r = r->next) {
+        if (r->start >= start && r->end <= end) {
+            r->flags = flags;
+        }
+    }
+    return 0;
+}
+
+/* Find the highest free, page-aligned range of size bytes in [low, high) */
+uint32_t region_find_gap(vm_region_t* list, uint32_t size, uint32_t low, uint32_t high) {
+    uint32_t best = 0;
+    uint32_t gap_start = low;
+    
+    for (vm_region_t* r = list; r != NULL; r = r->next) {
+        uint32_t r_lo = r->start & ~(PAGE_SIZE - 1);
+        uint32_t r_hi = (r->end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        uint32_t gap_end = r_lo < high ? r_lo : high;
+        
+        if (gap_end > gap_start && gap_end - gap_start >= size) {
+            best = gap_end - size;
+        }
+        if (r_hi > gap_start) gap_start = r_hi;
+    }
+    
+    if (high > gap_start && high - gap_start >= size) {
+        best = high - size;
+    }
+    
+    return best;
+}
+
+/* Pages spanned by a list (a page shared by two regions counts twice) */
+uint32_t region_count_pages(vm_region_t* list) {
+    uint32_t pages = 0;
+    for (vm_region_t* r = list; r != NULL; r = r->next) {
+        uint32_t start = r->start & ~(PAGE_SIZE - 1);
+        uint32_t end = (r->end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        pages += (end - start) / PAGE_SIZE;
+    }
+    return pages;
+}
+
+/* Copy region list */
+int region_clone(vm_region_t* src, vm_region_t** dst) {
+    vm_region_t** tail = dst;
+    *dst = NULL;
+
+    for (vm_region_t* r = src; r != NULL; r = r->next) {
+        vm_region_t* copy = (vm_region_t*)kmem_cache_alloc(region_cache);
+        if (!copy) {
+            region_free_all(dst);
+            return -1;
+        }
+
+        *copy = *r;
+        copy->next = NULL;
+        if (copy->shm) {
+            shm_hold(copy->shm);
+        }
+        *tail = copy;
+        tail = &copy->next;
+    }
+
+    return 0;
+}
+
+/* Free all regions */
+void region_free_all(vm_region_t** list) {
+    vm_region_t* r = *list;
+    while (r) {
+        vm_region_t* next = r->next;
+        region_free(r);
+        r = next;
+    }
+    *list = NULL;
+}
+
+/* Does the region have file data in [page, page + PAGE_SIZE)? */
+static int region_has_data(vm_region_t* r, uint32_t page) {
+    if (!r->file || !r->file->read) return 0;
+    return r->start < page + PAGE_SIZE && r->start + r->file_size > page;
+}
+
+/* Copy region's file data for [page, page + PAGE_SIZE) into the frame */
+static void region_fill_page(vm_region_t* r, uint32_t page, uint8_t* frame) {
+    if (!region_has_data(r, page)) return;
+
+    uint32_t lo = r->start > page ? r->start : page;
+    uint32_t hi = r->start + r->file_size;
+    if (hi > page + PAGE_SIZE) hi = page + PAGE_SIZE;
+
+    r->file->read(r->file, r->file_offset + (lo - r->start), hi - lo, frame + (lo - page));
+}
+
+/* Union of the flags of all regions touching the page (0 if none) */
+static uint32_t region_page_flags(vm_region_t* list, uint32_t page) {
+    uint32_t flags = 0;
+    for (vm_region_t* r = list; r != NULL; r = r->next) {
+        if (r->start < page + PAGE_SIZE && r->end > page) {
+            flags |= r->flags | REGION_PRESENT;
+        }
+    }
+    return flags;
+}
+
+/* Check an access against the regions covering the address */
+int region_allows(vm_region_t* list, uint32_t addr, uint32_t error_code) {
+    uint32_t flags = region_page_flags(list, addr & ~0xFFF);
+    
+    if (!(flags & (REGION_READ | REGION_WRITE | REGION_EXEC))) return 0;
+    if ((error_code & PF_WRITE) && !(flags & REGION_WRITE)) return 0;
+    if ((error_code & PF_FETCH) && !(flags & REGION_EXEC)) return 0;
+    return 1;
+}
+
+/* PTE flags for a user page covered by regions with the given flags */
+static uint32_t region_pte_flags(uint32_t flags) {
+    uint32_t pte_flags = PAGE_PRESENT | PAGE_USER;
+    if (flags & REGION_WRITE) pte_flags |= PAGE_WRITE;
+    if (!(flags & REGION_EXEC)) pte_flags |= PAGE_NOEXEC;
+    return pte_flags;
+}
+
+/* Map a page straight from the file's own frame if it can provide one */
+static int region_map_direct(vm_region_t* r, uint32_t page, uint32_t pte_flags) {
+    if (!r->file || !r->file->map) return -1;
+    
+    /* The whole page must be file data, nothing to zero */
+    if (page < r->start || page + PAGE_SIZE > r->start + r->file_size) return -1;
+    
+    uint32_t offset = r->file_offset + (page - r->start);
+    if (offset & (PAGE_SIZE - 1)) return -1;
+    
+    uint32_t frame = r->file->map(r->file, offset);
+    if (!frame) return -1;
+    
+    /* The frame belongs to the file: writable mappings get a private copy */
+    if (pte_flags & PAGE_WRITE) {
+        pte_flags = (pte_flags & ~PAGE_WRITE) | PAGE_COW;
+    }
+    
+    vmm_map_page(page, frame, pte_flags);
+    return 0;
+}
+
+/* Bring a swapped-out page back, reading ahead the following pages of
+ * the same page table that went to the following slots; returns the
+ * number of pages mapped */
+static int region_swap_in(vm_region_t* list, uint32_t page, pte_t entry) {
+    uint32_t slot = SWAP_SLOT(entry);
+    uint32_t count = 1;
+    while (count < SWAP_CLUSTER) {
+        uint32_t next = page + count * PAGE_SIZE;
+        if (!(next & (LARGE_PAGE_SIZE - 1))) break;
+        if (vmm_get_entry(next) != SWAP_ENTRY(slot + count)) break;
+        count++;
+    }
+    
+    phys_addr_t frames[SWAP_CLUSTER];
+    count = swap_read(slot, count, frames);
+    if (!count) return -1;
+    
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t addr = page + i * PAGE_SIZE;
+        vmm_map_page(addr, frames[i], region_pte_flags(region_page_flags(list, addr)));
+    }
+    
+    return (int)count;
+}
+
+/* Demand-fill a page */
+int region_handle_fault(vm_region_t* list, uint32_t fault_addr, uint32_t error_code) {
+    /* Only not-present faults are ours */
+    if (error_code & PF_PRESENT) return -1;
+    if (!region_allows(list, fault_addr, error_code)) return -1;
+    
+    uint32_t page = fault_addr & ~0xFFF;
+    
+    pte_t entry = vmm_get_entry(page);
+    if (entry & PAGE_SWAPPED) {
+        return region_swap_in(list, page, entry);
+    }
+    
+    uint32_t pte_flags = region_pte_flags(region_page_flags(list, page));
+    
+    /* Shared memory: map the segment's own frame */
+    vm_region_t* whole = region_find(list, page);
+    if (whole && whole->shm) {
+        phys_addr_t frame = shm_frame(whole->shm, whole->file_offset + (page - whole->start));
+        if (!frame) return -1;
+        
+        pmm_ref_frame(frame);
+        vmm_map_page(page, frame, pte_flags | PAGE_SHARED);
+        return 1;
+    }
+    
+    /* Page-aligned file mappings may not need a copy at all */
+    if (whole && whole->start <= page && whole->end >= page + PAGE_SIZE &&
+        region_map_direct(whole, page, pte_flags) == 0) {
+        return 1;
+    }
+    
+    phys_addr_t frame = alloc_zeroed_frame();
+    if (!frame) {
+        kprintf("[REGION] Out of memory at 0x%x\n", fault_addr);
+        return -1;
+    }
+    
+    /* Anonymous pages (BSS, stack, heap) are done; only file-backed ones
+     * need the frame mapped in to copy data */
+    int has_data = 0;
+    for (vm_region_t* r = list; r != NULL; r = r->next) {
+        if (r->start < page + PAGE_SIZE && r->end > page && region_has_data(r, page)) {
+            has_data = 1;
+        }
+    }
+    
+    if (has_data) {
+        uint8_t* data = (uint8_t*)vmm_kmap(frame);
+        if (!data) {
+            free_frame(frame);
+            return -1;
+        }
+        
+        for (vm_region_t* r = list; r != NULL; r = r->next) {
+            if (r->start < page + PAGE_SIZE && r->end > page) {
+                region_fill_page(r, page, data);
+            }
+        }
+        vmm_kunmap(data);
+    }
+    
+    vmm_map_page(page, frame, pte_flags);
+    
+    return 1;
+}
@@ -0,0 +1,77 @@
+/* region.h - Demand-paged user address space regions */
+
+#ifndef REGION_H
+#define REGION_H
+
+#include <stdint.h>
+
+struct vfs_node;
+struct shm_segment;
+
+/* Region flags */
+#define REGION_READ    0x1
+#define REGION_WRITE   0x2
+#define REGION_EXEC    0x4
+#define REGION_PRESENT 0x80000000     /* Internal: page is covered at all */
+
+/* A mapped range of user space. Pages are populated on first touch:
+ * bytes [start, start + file_size) come from the backing file, the rest
+ * of the region is zero-filled. Whole file pages are mapped directly
+ * when the file can hand out its own frames (vfs map callback). Shared
+ * memory regions map the segment's frames instead. */
+typedef struct vm_region {
+    uint32_t start;                  /* First byte */
+    uint32_t end;                    /* One past the last byte */
+    uint32_t flags;
+    struct vfs_node* file;           /* Backing file, NULL for anonymous */
+    uint32_t file_offset;            /* File (or segment) offset of 'start' */
+    uint32_t file_size;              /* Bytes backed by the file */
+    struct shm_segment* shm;         /* Shared memory segment, NULL if none */
+    struct vm_region* next;
+} vm_region_t;
+
+/* Initialize region allocator */
+void region_init(void);
+
+/* Add region to a list (fails if it overlaps an existing one) */
+vm_region_t* region_add(vm_region_t** list, uint32_t start, uint32_t end, uint32_t flags,
+                        struct vfs_node* file, uint32_t file_offset, uint32_t file_size);
+
+/* Find region containing address */
+vm_region_t* region_find(vm_region_t* list, uint32_t addr);
+
+/* Move a region's end (grow or shrink); returns -1 on overlap. Pages
+ * beyond a shrunk end must be unmapped by the caller. */
+int region_resize(vm_region_t* list, vm_region_t* region, uint32_t new_end);
+
+/* Unlink and free one region */
+void region_remove(vm_region_t** list, vm_region_t* region);
+
+/* Remove [start, end) from a list, splitting regions at the edges */
+int region_unmap(vm_region_t** list, uint32_t start, uint32_t end);
+
+/* Set the flags of [start, end); fails if part of it is unmapped */
+int region_protect(vm_region_t* list, uint32_t start, uint32_t end, uint32_t flags);
+
+/* Highest free page-aligned range of size bytes within [low, high),
+ * 0 if there is none */
+uint32_t region_find_gap(vm_region_t* list, uint32_t size, uint32_t low, uint32_t high);
+
+/* Number of pages the regions of a list span */
+uint32_t region_count_pages(vm_region_t* list);
+
+/* Copy a region list (for fork); returns 0 on success */
+int region_clone(vm_region_t* src, vm_region_t** dst);
+
+/* Free all regions of a list */
+void region_free_all(vm_region_t** list);
+
+/* Whether the regions permit an access (page fault error code bits) */
+int region_allows(vm_region_t* list, uint32_t addr, uint32_t error_code);
+
+/* Populate a not-present page in the current address space from the
+ * regions covering it. Returns the number of pages mapped (more than one
+ * when swap readahead brings in neighbours), -1 if the access is invalid. */
+int region_handle_fault(vm_region_t* list, uint32_t fault_addr, uint32_t error_code);
+
+#endif /* REGION_H */
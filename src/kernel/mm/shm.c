@@ -0,0 +1,131 @@
+/* shm.c - Named shared memory segments
+ *
+ * A segment is a set of frames allocated once at creation. Attaching maps
+ * those same frames into the caller's address space on demand (see
+ * region_handle_fault), so producers and consumers exchange data without
+ * any copy. Mapped pages carry PAGE_SHARED so fork keeps them shared
+ * instead of turning them copy-on-write.
+ */
+
+#include "shm.h"
+#include "heap.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "zpool.h"
+#include "../core/console.h"
+
+static shm_segment_t segments[SHM_MAX_SEGMENTS];
+
+/* String helpers */
+static int strcmp(const char* s1, const char* s2) {
+    while (*s1 && (*s1 == *s2)) {
+        s1++;
+        s2++;
+    }
+    return *(unsigned char*)s1 - *(unsigned char*)s2;
+}
+
+static size_t strlen(const char* s) {
+    size_t len = 0;
+    while (s[len]) len++;
+    return len;
+}
+
+/* Free a segment's frames and slot */
+static void shm_destroy(shm_segment_t* seg) {
+    uint32_t pages = seg->size / PAGE_SIZE;
+    for (uint32_t i = 0; i < pages; i++) {
+        free_frame(seg->frames[i]);
+    }
+    kfree(seg->frames);
+
+    seg->frames = NULL;
+    seg->size = 0;
+    seg->name[0] = '\0';
+}
+
+/* Open or create segment */
+int shm_create(const char* name, uint32_t size) {
+    if (!name || !*name || strlen(name) >= SHM_NAME_LEN) return -1;
+
+    int free_slot = -1;
+    for (int i = 0; i < SHM_MAX_SEGMENTS; i++) {
+        if (!segments[i].frames) {
+            if (free_slot < 0) free_slot = i;
+            continue;
+        }
+        if (segments[i].named && strcmp(segments[i].name, name) == 0) {
+            return size <= segments[i].size ? i : -1;
+        }
+    }
+
+    if (free_slot < 0 || size == 0 || size > SHM_MAX_SIZE) return -1;
+
+    shm_segment_t* seg = &segments[free_slot];
+    uint32_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    seg->frames = (phys_addr_t*)kmalloc(pages * sizeof(phys_addr_t));
+    if (!seg->frames) return -1;
+
+    for (uint32_t i = 0; i < pages; i++) {
+        seg->frames[i] = alloc_zeroed_frame();
+        if (!seg->frames[i]) {
+            kprintf("[SHM] Out of memory creating %s\n", name);
+            seg->size = i * PAGE_SIZE;
+            shm_destroy(seg);
+            return -1;
+        }
+    }
+
+    size_t len = strlen(name);
+    for (size_t i = 0; i <= len; i++) {
+        seg->name[i] = name[i];
+    }
+    seg->size = pages * PAGE_SIZE;
+    seg->refs = 1;
+    seg->named = 1;
+
+    kprintf("[SHM] Created %s (%u pages)\n", name, pages);
+    return free_slot;
+}
+
+/* Remove segment name */
+int shm_unlink(const char* name) {
+    if (!name) return -1;
+
+    for (int i = 0; i < SHM_MAX_SEGMENTS; i++) {
+        shm_segment_t* seg = &segments[i];
+        if (seg->frames && seg->named && strcmp(seg->name, name) == 0) {
+            seg->named = 0;
+            shm_release(seg);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Look up segment and take a reference */
+shm_segment_t* shm_get(int id) {
+    if (id < 0 || id >= SHM_MAX_SEGMENTS || !segments[id].frames) return NULL;
+
+    segments[id].refs++;
+    return &segments[id];
+}
+
+/* Take another reference */
+void shm_hold(shm_segment_t* seg) {
+    seg->refs++;
+}
+
+/* Drop a reference, destroying the segment with the last one */
+void shm_release(shm_segment_t* seg) {
+    if (--seg->refs == 0) {
+        shm_destroy(seg);
+    }
+}
+
+/* Get frame for a page of the segment */
+phys_addr_t shm_frame(shm_segment_t* seg, uint32_t offset) {
+    if (offset >= seg->size) return 0;
+    return seg->frames[offset / PAGE_SIZE];
+}
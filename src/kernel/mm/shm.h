@@ -0,0 +1,41 @@
+/* shm.h - Named shared memory segments */
+
+#ifndef SHM_H
+#define SHM_H
+
+#include <stdint.h>
+#include "pmm.h"
+
+#define SHM_MAX_SEGMENTS 32
+#define SHM_NAME_LEN     32
+#define SHM_MAX_SIZE     0x1000000    /* 16MB per segment */
+
+/* A segment owns one reference to each of its frames; every page mapped
+ * into an address space holds another, so frames outlive the segment
+ * until the last mapping goes away. */
+typedef struct shm_segment {
+    char name[SHM_NAME_LEN];
+    uint32_t size;                   /* Bytes, page multiple */
+    phys_addr_t* frames;             /* One physical frame per page */
+    uint32_t refs;                   /* Attached regions + 1 while named */
+    int named;
+} shm_segment_t;
+
+/* Open a segment by name, creating it with size bytes (zeroed) if it does
+ * not exist. Returns its id, -1 on failure. */
+int shm_create(const char* name, uint32_t size);
+
+/* Remove a name; the segment goes away with its last attachment */
+int shm_unlink(const char* name);
+
+/* Look up a segment by id and take a reference (NULL if invalid) */
+shm_segment_t* shm_get(int id);
+
+/* Reference counting for regions attached to a segment */
+void shm_hold(shm_segment_t* seg);
+void shm_release(shm_segment_t* seg);
+
+/* Frame backing the page at byte offset within the segment */
+phys_addr_t shm_frame(shm_segment_t* seg, uint32_t offset);
+
+#endif /* SHM_H */
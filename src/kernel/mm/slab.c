@@ -0,0 +1,294 @@
+/* slab.c - Object caches for fixed-size kernel objects
+ *
+ * Each cache hands out objects of one size from slabs: power-of-two sized,
+ * naturally aligned chunks taken from the kernel heap. A slab begins with a
+ * small header followed by an array of object slots; free slots are chained
+ * through a link word inside the slot. Because slabs are aligned to their
+ * own size, kmem_cache_free() finds an object's slab by masking its address.
+ *
+ * Slabs sit on one of three per-cache lists (partial, full, empty) so
+ * allocation and free never search. At most SLAB_MAX_EMPTY empty slabs are
+ * kept around; the rest go back to the heap immediately.
+ *
+ * Caches with a constructor keep the free link after the object rather than
+ * inside it, so an object keeps its constructed state across free/alloc.
+ */
+
+#include "slab.h"
+#include "heap.h"
+#include "../core/console.h"
+
+#define SLAB_MAX_CACHES     32
+#define SLAB_MIN_SIZE       4096          /* One page */
+#define SLAB_MAX_SIZE       (128 * 1024)
+#define SLAB_MIN_OBJECTS    8             /* Grow slab size until this many fit */
+#define SLAB_MAX_EMPTY      1             /* Empty slabs kept per cache */
+#define SLAB_DEFAULT_ALIGN  4
+
+/* Slab header, stored at the start of every slab */
+typedef struct slab {
+    struct kmem_cache* cache;
+    struct slab* next;
+    struct slab* prev;
+    void* free_list;                 /* First free slot */
+    uint32_t inuse;                  /* Objects handed out */
+} slab_t;
+
+struct kmem_cache {
+    char name[KMEM_CACHE_NAME_LEN];
+    uint32_t object_size;            /* Size requested by creator */
+    uint32_t slot_size;              /* Object + free link, aligned */
+    uint32_t free_offset;            /* Offset of free link within slot */
+    uint32_t slab_size;              /* Bytes per slab (power of two) */
+    uint32_t first_offset;           /* Offset of first slot in slab */
+    uint32_t per_slab;               /* Slots per slab */
+    kmem_ctor_t ctor;
+
+    slab_t* partial;
+    slab_t* full;
+    slab_t* empty;
+    uint32_t nr_slabs;
+    uint32_t nr_empty;
+    uint32_t active;
+};
+
+static struct kmem_cache caches[SLAB_MAX_CACHES];
+static uint32_t cache_count = 0;
+
+/* String utilities */
+static char* strncpy(char* dest, const char* src, size_t n) {
+    char* ret = dest;
+    while (n && (*dest++ = *src++)) n--;
+    while (n--) *dest++ = '\0';
+    return ret;
+}
+
+static uint32_t align_up(uint32_t value, uint32_t align) {
+    return (value + align - 1) & ~(align - 1);
+}
+
+/* Slab list helpers */
+static void slab_list_push(slab_t** head, slab_t* slab) {
+    slab->prev = NULL;
+    slab->next = *head;
+    if (*head) {
+        (*head)->prev = slab;
+    }
+    *head = slab;
+}
+
+static void slab_list_remove(slab_t** head, slab_t* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *head = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->next = NULL;
+    slab->prev = NULL;
+}
+
+/* Free link stored in a slot */
+static void** slot_link(kmem_cache_t* cache, void* obj) {
+    return (void**)((uint8_t*)obj + cache->free_offset);
+}
+
+/* Initialize slab allocator */
+void slab_init(void) {
+    cache_count = 0;
+}
+
+/* Create object cache */
+kmem_cache_t* kmem_cache_create(const char* name, size_t size, uint32_t align,
+                                kmem_ctor_t ctor) {
+    if (!name || size == 0) return NULL;
+
+    if (align == 0) {
+        align = SLAB_DEFAULT_ALIGN;
+    }
+    if (align & (align - 1)) {
+        kprintf("[SLAB] %s: alignment %u is not a power of two\n", name, align);
+        return NULL;
+    }
+
+    if (cache_count >= SLAB_MAX_CACHES) {
+        kprintf("[SLAB] Too many caches, cannot create %s\n", name);
+        return NULL;
+    }
+
+    kmem_cache_t* cache = &caches[cache_count];
+
+    /* Lay out the slot */
+    uint32_t slot = size < sizeof(void*) ? sizeof(void*) : size;
+    cache->free_offset = 0;
+    if (ctor) {
+        cache->free_offset = align_up(size, sizeof(void*));
+        slot = cache->free_offset + sizeof(void*);
+    }
+    cache->slot_size = align_up(slot, align);
+    cache->first_offset = align_up(sizeof(slab_t), align);
+
+    /* Pick the smallest slab that holds enough objects */
+    uint32_t slab_size = SLAB_MIN_SIZE;
+    while (slab_size < SLAB_MAX_SIZE &&
+           (slab_size - cache->first_offset) / cache->slot_size < SLAB_MIN_OBJECTS) {
+        slab_size <<= 1;
+    }
+
+    if (slab_size <= cache->first_offset ||
+        (slab_size - cache->first_offset) / cache->slot_size == 0) {
+        kprintf("[SLAB] %s: object size %u too large\n", name, (uint32_t)size);
+        return NULL;
+    }
+
+    strncpy(cache->name, name, KMEM_CACHE_NAME_LEN - 1);
+    cache->name[KMEM_CACHE_NAME_LEN - 1] = '\0';
+    cache->object_size = size;
+    cache->slab_size = slab_size;
+    cache->per_slab = (slab_size - cache->first_offset) / cache->slot_size;
+    cache->ctor = ctor;
+    cache->partial = NULL;
+    cache->full = NULL;
+    cache->empty = NULL;
+    cache->nr_slabs = 0;
+    cache->nr_empty = 0;
+    cache->active = 0;
+
+    cache_count++;
+
+    return cache;
+}
+
+/* Carve a new slab from the heap and put it on the empty list */
+static slab_t* slab_grow(kmem_cache_t* cache) {
+    slab_t* slab = (slab_t*)kmalloc_aligned(cache->slab_size, cache->slab_size);
+    if (!slab) return NULL;
+
+    slab->cache = cache;
+    slab->inuse = 0;
+    slab->free_list = NULL;
+
+    /* Chain slots in address order, constructing each object */
+    uint8_t* base = (uint8_t*)slab + cache->first_offset;
+    for (uint32_t i = cache->per_slab; i > 0; i--) {
+        void* obj = base + (i - 1) * cache->slot_size;
+        if (cache->ctor) {
+            cache->ctor(obj);
+        }
+        *slot_link(cache, obj) = slab->free_list;
+        slab->free_list = obj;
+    }
+
+    slab_list_push(&cache->empty, slab);
+    cache->nr_slabs++;
+    cache->nr_empty++;
+
+    return slab;
+}
+
+/* Give an empty slab back to the heap */
+static void slab_release(kmem_cache_t* cache, slab_t* slab) {
+    slab_list_remove(&cache->empty, slab);
+    cache->nr_slabs--;
+    cache->nr_empty--;
+    kfree(slab);
+}
+
+/* Allocate object from cache */
+void* kmem_cache_alloc(kmem_cache_t* cache) {
+    if (!cache) return NULL;
+
+    slab_t* slab = cache->partial;
+    if (!slab) {
+        slab = cache->empty;
+        if (!slab) {
+            slab = slab_grow(cache);
+            if (!slab) return NULL;
+        }
+        slab_list_remove(&cache->empty, slab);
+        cache->nr_empty--;
+        slab_list_push(&cache->partial, slab);
+    }
+
+    void* obj = slab->free_list;
+    slab->free_list = *slot_link(cache, obj);
+    slab->inuse++;
+    cache->active++;
+
+    if (slab->inuse == cache->per_slab) {
+        slab_list_remove(&cache->partial, slab);
+        slab_list_push(&cache->full, slab);
+    }
+
+    return obj;
+}
+
+/* Return object to cache */
+void kmem_cache_free(kmem_cache_t* cache, void* obj) {
+    if (!cache || !obj) return;
+
+    slab_t* slab = (slab_t*)((uint32_t)obj & ~(cache->slab_size - 1));
+    uint32_t offset = (uint32_t)obj - (uint32_t)slab;
+
+    if (slab->cache != cache || offset < cache->first_offset ||
+        (offset - cache->first_offset) % cache->slot_size != 0 ||
+        slab->inuse == 0) {
+        kprintf("[SLAB] %s: bad free of 0x%x\n", cache->name, (uint32_t)obj);
+        return;
+    }
+
+    if (slab->inuse == cache->per_slab) {
+        slab_list_remove(&cache->full, slab);
+        slab_list_push(&cache->partial, slab);
+    }
+
+    *slot_link(cache, obj) = slab->free_list;
+    slab->free_list = obj;
+    slab->inuse--;
+    cache->active--;
+
+    if (slab->inuse == 0) {
+        slab_list_remove(&cache->partial, slab);
+        slab_list_push(&cache->empty, slab);
+        cache->nr_empty++;
+
+        if (cache->nr_empty > SLAB_MAX_EMPTY) {
+            slab_release(cache, slab);
+        }
+    }
+}
+
+/* Release all empty slabs */
+void kmem_cache_shrink(kmem_cache_t* cache) {
+    if (!cache) return;
+
+    while (cache->empty) {
+        slab_release(cache, cache->empty);
+    }
+}
+
+/* Number of caches */
+uint32_t kmem_cache_count(void) {
+    return cache_count;
+}
+
+/* Get statistics for cache by index */
+int kmem_cache_get_info(uint32_t index, kmem_cache_info_t* info) {
+    if (index >= cache_count || !info) return -1;
+
+    kmem_cache_t* cache = &caches[index];
+
+    strncpy(info->name, cache->name, KMEM_CACHE_NAME_LEN);
+    info->object_size = cache->object_size;
+    info->slab_size = cache->slab_size;
+    info->objects_per_slab = cache->per_slab;
+    info->active_objects = cache->active;
+    info->total_objects = cache->nr_slabs * cache->per_slab;
+    info->slabs = cache->nr_slabs;
+    info->waste = cache->nr_slabs *
+                  (cache->slab_size - cache->per_slab * cache->object_size);
+
+    return 0;
+}
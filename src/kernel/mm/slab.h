@@ -0,0 +1,50 @@
+/* slab.h - Object caches for fixed-size kernel objects */
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define KMEM_CACHE_NAME_LEN 24
+
+/* Object constructor, run once when an object's slab is created */
+typedef void (*kmem_ctor_t)(void* obj);
+
+typedef struct kmem_cache kmem_cache_t;
+
+/* Cache statistics */
+typedef struct {
+    char name[KMEM_CACHE_NAME_LEN];
+    uint32_t object_size;            /* Requested object size */
+    uint32_t slab_size;              /* Bytes per slab */
+    uint32_t objects_per_slab;
+    uint32_t active_objects;         /* Objects handed out */
+    uint32_t total_objects;          /* Objects in all slabs */
+    uint32_t slabs;                  /* Slabs currently held */
+    uint32_t waste;                  /* Slab bytes not usable for objects */
+} kmem_cache_info_t;
+
+/* Initialize slab allocator (call after heap_init) */
+void slab_init(void);
+
+/* Create a cache of objects of the given size (align 0 = default).
+ * Objects from a cache with a constructor must be freed back in their
+ * constructed state. */
+kmem_cache_t* kmem_cache_create(const char* name, size_t size, uint32_t align,
+                                kmem_ctor_t ctor);
+
+/* Allocate object from cache */
+void* kmem_cache_alloc(kmem_cache_t* cache);
+
+/* Return object to cache */
+void kmem_cache_free(kmem_cache_t* cache, void* obj);
+
+/* Release all empty slabs back to the heap */
+void kmem_cache_shrink(kmem_cache_t* cache);
+
+/* Enumerate caches for statistics */
+uint32_t kmem_cache_count(void);
+int kmem_cache_get_info(uint32_t index, kmem_cache_info_t* info);
+
+#endif /* SLAB_H */
@@ -0,0 +1,336 @@
+/* swap.c - Paging user memory out to an ATA swap partition
+ *
+ * At boot the ATA drives are searched for an MBR partition of type 0x82;
+ * its pages become swap slots, each with a small reference count since
+ * fork copies swapped-out PTEs. When a frame cannot be found for user
+ * memory, swap_reclaim() runs a clock over the user page tables of every
+ * process: a page whose accessed bit is set has it cleared and gets a
+ * second chance, a page still unaccessed when the hand comes round is
+ * written out and its PTE replaced with a swap entry. Only private frames
+ * (refcount 1) are evicted; shared memory, copy-on-write pages still
+ * shared after fork and file pages mapped in place stay resident.
+ *
+ * Victims are gathered per page table and written SWAP_CLUSTER at a time
+ * to consecutive slots, so pages that were neighbours in memory stay
+ * neighbours on disk and the fault path can read a whole cluster back
+ * with one request (see region_handle_fault).
+ */
+
+#include "swap.h"
+#include "vmm.h"
+#include "heap.h"
+#include "../drivers/ata.h"
+#include "../proc/process.h"
+#include "../core/console.h"
+
+#define SECTORS_PER_PAGE (PAGE_SIZE / ATA_SECTOR_SIZE)
+#define SLOT_REFS_MAX    0xFF           /* Saturated slots are never freed */
+
+static int swap_drive = -1;
+static uint32_t swap_lba = 0;            /* First sector of the partition */
+static uint32_t swap_slots = 0;
+static uint8_t* slot_refs = NULL;        /* PTEs referring to each slot, 0 = free */
+static uint32_t slot_cursor = 0;         /* Next-fit allocation start */
+static uint32_t slots_used = 0;
+static uint8_t* bounce = NULL;           /* SWAP_CLUSTER pages of I/O buffer */
+
+/* Clock hand: address space and address the scan resumes at */
+static uint32_t hand_pid = 0;
+static uint32_t hand_addr = USER_SPACE_START;
+
+static uint32_t pages_in = 0;
+static uint32_t pages_out = 0;
+static uint32_t disk_reads = 0;
+static uint32_t disk_writes = 0;
+
+/* Copy one page */
+static void copy_page(void* dst, const void* src) {
+    uint32_t count = PAGE_SIZE / 4;
+    __asm__ volatile("rep movsl" : "+D"(dst), "+S"(src), "+c"(count) :: "memory");
+}
+
+/* Find a swap partition and set up the slot map */
+void swap_init(void) {
+    uint8_t* mbr = (uint8_t*)kmalloc(ATA_SECTOR_SIZE);
+    if (!mbr) return;
+
+    for (int drive = 0; drive < 4 && swap_drive < 0; drive++) {
+        if (!ata_get_size(drive)) continue;
+        if (ata_read_sectors(drive, 0, 1, mbr) != 1) continue;
+        if (mbr[510] != 0x55 || mbr[511] != 0xAA) continue;
+
+        for (int i = 0; i < 4; i++) {
+            uint8_t* entry = mbr + 446 + i * 16;
+            uint32_t start = *(uint32_t*)(entry + 8);
+            uint32_t sectors = *(uint32_t*)(entry + 12);
+
+            if (entry[4] == SWAP_PART_TYPE && sectors >= SECTORS_PER_PAGE) {
+                swap_drive = drive;
+                swap_lba = start;
+                swap_slots = sectors / SECTORS_PER_PAGE;
+                break;
+            }
+        }
+    }
+    kfree(mbr);
+
+    if (swap_drive < 0) {
+        kprintf("[SWAP] No swap partition found\n");
+        return;
+    }
+
+    if (swap_slots > SWAP_MAX_SLOTS) {
+        swap_slots = SWAP_MAX_SLOTS;
+    }
+
+    slot_refs = (uint8_t*)kmalloc(swap_slots);
+    bounce = (uint8_t*)kmalloc_aligned(SWAP_CLUSTER * PAGE_SIZE, PAGE_SIZE);
+    if (!slot_refs || !bounce) {
+        kfree(slot_refs);
+        kfree(bounce);
+        swap_drive = -1;
+        kprintf("[SWAP] Out of memory for slot map\n");
+        return;
+    }
+
+    for (uint32_t i = 0; i < swap_slots; i++) {
+        slot_refs[i] = 0;
+    }
+
+    kprintf("[SWAP] Drive %d: %u KB at sector %u\n", swap_drive, swap_slots * 4, swap_lba);
+}
+
+/* Claim count consecutive free slots (returns the first, -1 if none) */
+static int slot_alloc(uint32_t count) {
+    uint32_t run = 0;
+
+    for (uint32_t n = 0; n < swap_slots + count; n++) {
+        uint32_t slot = (slot_cursor + n) % swap_slots;
+        if (slot == 0) run = 0;         /* Runs never wrap around */
+
+        if (slot_refs[slot]) {
+            run = 0;
+            continue;
+        }
+        if (++run < count) continue;
+
+        uint32_t first = slot + 1 - count;
+        for (uint32_t i = 0; i < count; i++) {
+            slot_refs[first + i] = 1;
+        }
+        slots_used += count;
+        slot_cursor = (slot + 1) % swap_slots;
+        return (int)first;
+    }
+
+    return -1;
+}
+
+/* Add a reference to a slot */
+void swap_dup(uint32_t slot) {
+    if (slot < swap_slots && slot_refs[slot] && slot_refs[slot] < SLOT_REFS_MAX) {
+        slot_refs[slot]++;
+    }
+}
+
+/* Drop a reference to a slot */
+void swap_free(uint32_t slot) {
+    if (slot >= swap_slots || !slot_refs[slot] || slot_refs[slot] == SLOT_REFS_MAX) return;
+
+    if (--slot_refs[slot] == 0) {
+        slots_used--;
+    }
+}
+
+/* Write a batch of victim pages to consecutive slots and free their frames.
+ * Returns the number of pages evicted (0 when swap is full or I/O failed). */
+static uint32_t swap_write_batch(uint32_t* pd, pte_t** ptes, uint32_t* addrs, uint32_t count) {
+    int slot = slot_alloc(count);
+    if (slot < 0) return 0;
+
+    uint32_t copied = 0;
+    for (; copied < count; copied++) {
+        void* src = vmm_kmap(PTE_FRAME(*ptes[copied]));
+        if (!src) break;
+        copy_page(bounce + copied * PAGE_SIZE, src);
+        vmm_kunmap(src);
+    }
+
+    if (copied < count ||
+        ata_write_sectors(swap_drive, swap_lba + slot * SECTORS_PER_PAGE,
+                          count * SECTORS_PER_PAGE, bounce) < 0) {
+        kprintf("[SWAP] Write of %u pages at slot %u failed\n", count, slot);
+        for (uint32_t i = 0; i < count; i++) {
+            swap_free(slot + i);
+        }
+        return 0;
+    }
+    disk_writes++;
+
+    for (uint32_t i = 0; i < count; i++) {
+        phys_addr_t frame = PTE_FRAME(*ptes[i]);
+        *ptes[i] = SWAP_ENTRY(slot + i);
+        vmm_invalidate_page(pd, addrs[i]);
+        free_frame(frame);
+    }
+
+    pages_out += count;
+    return count;
+}
+
+/* Advance the hand through one address space until target pages have
+ * been evicted or the end of user space is reached. Sets *stop when no
+ * more pages can be written. */
+static uint32_t swap_scan(uint32_t* pd, uint32_t target, int* stop) {
+    uint32_t freed = 0;
+
+    while (hand_addr < USER_SPACE_END && freed < target) {
+        uint32_t table_end = (hand_addr & ~(LARGE_PAGE_SIZE - 1)) + LARGE_PAGE_SIZE;
+        pte_t* pt = vmm_get_page_table(pd, hand_addr);
+        if (!pt) {
+            hand_addr = table_end;
+            continue;
+        }
+
+        pte_t* ptes[SWAP_CLUSTER];
+        uint32_t addrs[SWAP_CLUSTER];
+        uint32_t count = 0;
+
+        for (; hand_addr < table_end && freed + count < target; hand_addr += PAGE_SIZE) {
+            pte_t* pte = &pt[(hand_addr >> 12) & (PAGE_TABLE_ENTRIES - 1)];
+            pte_t entry = *pte;
+
+            if ((entry & (PAGE_PRESENT | PAGE_USER)) != (PAGE_PRESENT | PAGE_USER)) continue;
+            if (entry & PAGE_SHARED) continue;
+            if (pmm_get_refcount(PTE_FRAME(entry)) != 1) continue;
+
+            /* Second chance */
+            if (entry & PAGE_ACCESSED) {
+                *pte = entry & ~PAGE_ACCESSED;
+                vmm_invalidate_page(pd, hand_addr);
+                continue;
+            }
+
+            ptes[count] = pte;
+            addrs[count] = hand_addr;
+            if (++count == SWAP_CLUSTER) {
+                uint32_t written = swap_write_batch(pd, ptes, addrs, count);
+                count = 0;
+                if (!written) {
+                    *stop = 1;
+                    return freed;
+                }
+                freed += written;
+            }
+        }
+
+        if (count) {
+            uint32_t written = swap_write_batch(pd, ptes, addrs, count);
+            if (!written) {
+                *stop = 1;
+                return freed;
+            }
+            freed += written;
+        }
+    }
+
+    return freed;
+}
+
+/* Evict cold user pages */
+uint32_t swap_reclaim(uint32_t target) {
+    if (swap_drive < 0) return 0;
+
+    /* Resume at the hand's process; its table slot may have changed */
+    process_t* proc = process_get_by_pid(hand_pid);
+    uint32_t index = 0;
+    if (proc) {
+        index = proc->table_index;
+    } else {
+        proc = process_get_at(0);
+        hand_addr = USER_SPACE_START;
+    }
+
+    /* Stop after wrapping around twice: the first lap may only have
+     * cleared accessed bits */
+    uint32_t freed = 0;
+    int wraps = 0;
+    int stop = 0;
+    while (proc && freed < target && !stop) {
+        /* Threads share their leader's page directory, scan it once */
+        if (proc->page_directory && !proc->group_leader) {
+            uint32_t evicted = swap_scan(proc->page_directory, target - freed, &stop);
+            process_account_rss(proc, -(int)evicted);
+            freed += evicted;
+            if (hand_addr < USER_SPACE_END) break;
+        }
+
+        hand_addr = USER_SPACE_START;
+        proc = process_get_at(++index);
+        if (!proc) {
+            index = 0;
+            proc = process_get_at(0);
+            if (++wraps == 2) break;
+        }
+    }
+
+    hand_pid = proc ? proc->pid : 0;
+    return freed;
+}
+
+/* Read consecutive slots back into fresh frames */
+uint32_t swap_read(uint32_t slot, uint32_t count, phys_addr_t* frames) {
+    if (swap_drive < 0 || slot >= swap_slots) return 0;
+    if (count > SWAP_CLUSTER) count = SWAP_CLUSTER;
+    if (count > swap_slots - slot) count = swap_slots - slot;
+
+    /* Readahead is best effort: only the faulting page must get a frame */
+    uint32_t got = 0;
+    while (got < count) {
+        phys_addr_t frame = pmm_alloc_pages(0, PMM_HIGHMEM);
+        if (!frame && got == 0 && swap_reclaim(SWAP_CLUSTER)) {
+            frame = pmm_alloc_pages(0, PMM_HIGHMEM);
+        }
+        if (!frame) break;
+        frames[got++] = frame;
+    }
+    if (!got) return 0;
+
+    int ok = ata_read_sectors(swap_drive, swap_lba + slot * SECTORS_PER_PAGE,
+                              got * SECTORS_PER_PAGE, bounce) >= 0;
+    if (ok) {
+        disk_reads++;
+    }
+
+    uint32_t copied = 0;
+    for (; ok && copied < got; copied++) {
+        void* dst = vmm_kmap(frames[copied]);
+        if (!dst) break;
+        copy_page(dst, bounce + copied * PAGE_SIZE);
+        vmm_kunmap(dst);
+    }
+
+    for (uint32_t i = copied; i < got; i++) {
+        free_frame(frames[i]);
+    }
+    for (uint32_t i = 0; i < copied; i++) {
+        swap_free(slot + i);
+    }
+
+    if (!copied) {
+        kprintf("[SWAP] Read of slot %u failed\n", slot);
+    }
+
+    pages_in += copied;
+    return copied;
+}
+
+/* Usage and I/O counters */
+void swap_get_stats(swap_stats_t* stats) {
+    stats->total_slots = swap_slots;
+    stats->used_slots = slots_used;
+    stats->pages_in = pages_in;
+    stats->pages_out = pages_out;
+    stats->reads = disk_reads;
+    stats->writes = disk_writes;
+}
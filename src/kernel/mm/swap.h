@@ -0,0 +1,43 @@
+/* swap.h - Paging user memory out to an ATA swap partition */
+
+#ifndef SWAP_H
+#define SWAP_H
+
+#include <stdint.h>
+#include "pmm.h"
+
+#define SWAP_CLUSTER     8              /* Pages per write batch and readahead */
+#define SWAP_MAX_SLOTS   65536          /* 256MB of swap at most */
+#define SWAP_PART_TYPE   0x82           /* MBR partition type */
+
+/* A swapped-out PTE is not present and holds its slot in the frame bits */
+#define SWAP_ENTRY(slot) (((slot) << 12) | PAGE_SWAPPED)
+#define SWAP_SLOT(entry) ((uint32_t)((entry) >> 12))
+
+typedef struct {
+    uint32_t total_slots;
+    uint32_t used_slots;
+    uint32_t pages_in;
+    uint32_t pages_out;
+    uint32_t reads;                     /* Disk requests, one per cluster */
+    uint32_t writes;
+} swap_stats_t;
+
+/* Look for a swap partition on the ATA drives (call after ata_init) */
+void swap_init(void);
+
+/* Evict up to target cold user pages; returns how many frames were freed */
+uint32_t swap_reclaim(uint32_t target);
+
+/* Read count consecutive slots into fresh frames (stored in frames[]) and
+ * release the slots. Returns how many pages were read, 0 on failure. */
+uint32_t swap_read(uint32_t slot, uint32_t count, phys_addr_t* frames);
+
+/* Slot references, for PTEs copied by fork and dropped by unmap */
+void swap_dup(uint32_t slot);
+void swap_free(uint32_t slot);
+
+/* Usage and I/O counters */
+void swap_get_stats(swap_stats_t* stats);
+
+#endif /* SWAP_H */
@@ -1,60 +1,189 @@
-/* vmm.c - Virtual Memory Manager (Fixed Implementation) */
+/* vmm.c - Virtual Memory Manager (Fixed Implementation)
+ *
+ * Two-level 32-bit paging by default. Built with PAE=1 the tables hold
+ * 64-bit entries (PDPT -> page directory -> page table), so user pages
+ * can live in frames above 4GB and, where the CPU has it, non-executable
+ * mappings get the NX bit. The user ABI and the virtual layout are the
+ * same either way; only the span of a page table (LARGE_PAGE_SIZE) drops
+ * from 4MB to 2MB.
+ */
 
 #include "vmm.h"
 #include "heap.h"
 #include "memory.h"
+#include "pmm.h"
+#include "swap.h"
+#include "zpool.h"
 #include "../core/console.h"
 
-#define PAGE_DIRECTORY_INDEX(x) ((x) >> 22)
-#define PAGE_TABLE_INDEX(x) (((x) >> 12) & 0x3FF)
-#define PAGE_GET_PHYSICAL_ADDRESS(x) (*(x) & ~0xFFF)
+#define PAGE_DIRECTORY_INDEX(x) ((x) >> PDE_SHIFT)
+#define PAGE_TABLE_INDEX(x) (((x) >> 12) & (PAGE_TABLE_ENTRIES - 1))
+#define PAGE_GET_PHYSICAL_ADDRESS(x) PTE_FRAME(*(x))
 
-/* Page frame allocator - simple bitmap */
-#define MAX_FRAMES 32768  /* 128MB / 4KB */
-static uint32_t frame_bitmap[MAX_FRAMES / 32];
-static uint32_t next_free_frame = 0;
+/* Top-level tables of an address space: one buddy block of
+ * 2^PD_BLOCK_ORDER frames with PD_ENTRIES private entries, CR3 pointing
+ * PDPT_OFFSET bytes into it */
+#ifdef CONFIG_PAE
+#define PD_BLOCK_ORDER  2                       /* Three directories + PDPT */
+#define PD_ENTRIES      (3 * PAGE_TABLE_ENTRIES)
+#define PDPT_OFFSET     (3 * PAGE_SIZE)
+#define PTE_NX          (1ULL << 63)
+#else
+#define PD_BLOCK_ORDER  0
+#define PD_ENTRIES      PAGE_TABLE_ENTRIES
+#define PDPT_OFFSET     0
+#endif
 
 /* Current page directory */
 static uint32_t* current_page_directory = NULL;
 static uint32_t* kernel_page_directory = NULL;
 
-/* Allocate a physical frame */
-static uint32_t alloc_frame(void) {
-    for (uint32_t i = 0; i < MAX_FRAMES; i++) {
-        uint32_t frame = (next_free_frame + i) % MAX_FRAMES;
-        uint32_t byte = frame / 32;
-        uint32_t bit = frame % 32;
-        
-        if (!(frame_bitmap[byte] & (1 << bit))) {
-            frame_bitmap[byte] |= (1 << bit);
-            next_free_frame = (frame + 1) % MAX_FRAMES;
-            return frame * PAGE_SIZE;
+#ifdef CONFIG_PAE
+/* Directory for USER_SPACE_END and up, shared by every PDPT */
+static pte_t* kernel_high_pd = NULL;
+#endif
+
+/* Temporary kernel mappings for frames outside the direct map */
+#define KMAP_SLOTS ((KMAP_END - KMAP_START) / PAGE_SIZE)
+static pte_t* kmap_table = NULL;
+static uint32_t kmap_used[KMAP_SLOTS / 32];
+static uint32_t kmap_next = 0;
+
+/* CPU paging features */
+#define CPUID_PSE  (1 << 3)
+#define CPUID_PAE  (1 << 6)
+#define CPUID_PGE  (1 << 13)
+#define CPUID_NX   (1 << 20)                  /* Leaf 0x80000001 EDX */
+#define CR4_PSE    0x10
+#define CR4_PAE    0x20
+#define CR4_PGE    0x80
+#define MSR_EFER   0xC0000080
+#define EFER_NXE   (1 << 11)
+static int pse_enabled = 0;
+static uint32_t global_flag = 0;              /* PAGE_GLOBAL if PGE is on */
+static pte_t nx_flag = 0;                     /* PTE_NX if NX is on */
+
+/* Ranges up to this many pages are flushed page by page */
+#define VMM_INVLPG_MAX 32
+
+/* Detect PSE/PGE (and PAE/NX) and enable them in CR4 and EFER */
+static void vmm_enable_paging_features(void) {
+    uint32_t eax, ebx, ecx, edx;
+    __asm__ volatile("cpuid"
+                     : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+                     : "a"(1));
+    
+    uint32_t cr4;
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    if (edx & CPUID_PGE) {
+        cr4 |= CR4_PGE;
+        global_flag = PAGE_GLOBAL;
+    }
+#ifdef CONFIG_PAE
+    if (!(edx & CPUID_PAE)) {
+        kprintf("[VMM] Kernel built for PAE but the CPU lacks it\n");
+        __asm__ volatile("cli; hlt");
+    }
+    
+    /* 2MB pages come with PAE, no PSE needed */
+    cr4 |= CR4_PAE;
+    pse_enabled = 1;
+    
+    __asm__ volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0x80000000));
+    if (eax >= 0x80000001) {
+        __asm__ volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0x80000001));
+        if (edx & CPUID_NX) {
+            uint32_t lo, hi;
+            __asm__ volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(MSR_EFER));
+            __asm__ volatile("wrmsr" :: "a"(lo | EFER_NXE), "d"(hi), "c"(MSR_EFER));
+            nx_flag = PTE_NX;
         }
     }
+#else
+    if (edx & CPUID_PSE) {
+        cr4 |= CR4_PSE;
+        pse_enabled = 1;
+    }
+#endif
+    __asm__ volatile("mov %0, %%cr4" :: "r"(cr4));
+    
+    kprintf("[VMM] %s paging, large pages: %s, global pages: %s, NX: %s\n",
+            PDE_SHIFT == 21 ? "PAE" : "32-bit", pse_enabled ? "yes" : "no",
+            global_flag ? "yes" : "no", nx_flag ? "yes" : "no");
+}
+
+/* Directory entry covering virtual_addr */
+static pte_t* vmm_pde(uint32_t* pd, uint32_t virtual_addr) {
+    uint32_t index = PAGE_DIRECTORY_INDEX(virtual_addr);
+#ifdef CONFIG_PAE
+    if (index >= PD_ENTRIES) {
+        return &kernel_high_pd[index - PD_ENTRIES];
+    }
+#endif
+    return &((pte_t*)pd)[index];
+}
+
+/* Allocate the cleared top-level tables of an address space */
+static uint32_t* vmm_alloc_directory(void) {
+    uint32_t base = pmm_alloc_pages(PD_BLOCK_ORDER, PMM_LOWMEM);
+    if (!base) return NULL;
+    
+    pte_t* pd = (pte_t*)base;
+    for (uint32_t i = 0; i < PD_ENTRIES; i++) {
+        pd[i] = 0;
+    }
+    
+#ifdef CONFIG_PAE
+    /* PDPT entries only take the present bit */
+    pte_t* pdpt = (pte_t*)(base + PDPT_OFFSET);
+    for (uint32_t i = 0; i < 3; i++) {
+        pdpt[i] = (base + i * PAGE_SIZE) | PAGE_PRESENT;
+    }
+    pdpt[3] = (uint32_t)kernel_high_pd | PAGE_PRESENT;
+#endif
     
-    return 0;  /* Out of memory */
+    return (uint32_t*)base;
 }
 
-/* Free a physical frame */
-static void free_frame(uint32_t addr) {
-    uint32_t frame = addr / PAGE_SIZE;
-    if (frame >= MAX_FRAMES) return;
+/* Turn PAGE_* mapping flags into PTE bits */
+static pte_t vmm_pte_flags(uint32_t flags) {
+    /* Global entries are only for mappings shared by every address space */
+    if (!global_flag || (flags & PAGE_USER)) {
+        flags &= ~PAGE_GLOBAL;
+    }
     
-    uint32_t byte = frame / 32;
-    uint32_t bit = frame % 32;
-    frame_bitmap[byte] &= ~(1 << bit);
+    pte_t bits = (flags & 0xFFF) | PAGE_PRESENT;
+    if (flags & PAGE_NOEXEC) {
+        bits |= nx_flag;
+    }
+    return bits;
+}
+
+/* Flush the whole TLB, global entries included */
+static void vmm_flush_tlb_global(void) {
+    __asm__ volatile(
+        "mov %%cr4, %%eax\n"
+        "xor $0x80, %%eax\n"      /* Toggling PGE drops global entries */
+        "mov %%eax, %%cr4\n"
+        "xor $0x80, %%eax\n"
+        "mov %%eax, %%cr4\n"
+        ::: "eax", "memory"
+    );
 }
 
 /* Get page table entry - fixed version */
-static uint32_t* vmm_get_page(uint32_t virtual_addr, int create, uint32_t** page_directory) {
+static pte_t* vmm_get_page(uint32_t virtual_addr, int create, uint32_t** page_directory) {
     uint32_t* pd = page_directory ? *page_directory : current_page_directory;
     if (!pd) return NULL;
     
-    uint32_t pd_index = PAGE_DIRECTORY_INDEX(virtual_addr);
+    pte_t* pde = vmm_pde(pd, virtual_addr);
     uint32_t pt_index = PAGE_TABLE_INDEX(virtual_addr);
     
+    /* Large pages have no page table to return */
+    if (*pde & PAGE_LARGE) return NULL;
+    
     /* Check if page table exists */
-    if (!(pd[pd_index] & PAGE_PRESENT)) {
+    if (!(*pde & PAGE_PRESENT)) {
         if (!create) return NULL;
         
         /* Allocate physical frame for page table */
@@ -65,17 +194,21 @@ static uint32_t* vmm_get_page(uint32_t virtual_addr, int create, uint32_t** page
         }
         
         /* Clear page table (use physical address directly during early boot) */
-        uint32_t* page_table = (uint32_t*)pt_phys;
-        for (int i = 0; i < 1024; i++) {
+        pte_t* page_table = (pte_t*)pt_phys;
+        for (uint32_t i = 0; i < PAGE_TABLE_ENTRIES; i++) {
             page_table[i] = 0;
         }
         
-        /* Add to page directory */
-        pd[pd_index] = pt_phys | PAGE_PRESENT | PAGE_WRITE;
+        /* Add to page directory; user tables must allow ring 3 access,
+         * the PTEs decide the real permissions */
+        *pde = pt_phys | PAGE_PRESENT | PAGE_WRITE;
+        if (virtual_addr >= USER_SPACE_START && virtual_addr < USER_SPACE_END) {
+            *pde |= PAGE_USER;
+        }
     }
     
-    /* Get page table */
-    uint32_t* page_table = (uint32_t*)PAGE_GET_PHYSICAL_ADDRESS(&pd[pd_index]);
+    /* Get page table (page tables live in low memory) */
+    pte_t* page_table = (pte_t*)(uint32_t)PAGE_GET_PHYSICAL_ADDRESS(pde);
     
     return &page_table[pt_index];
 }
@@ -84,50 +217,69 @@ static uint32_t* vmm_get_page(uint32_t virtual_addr, int create, uint32_t** page
 void vmm_init(void) {
     kprintf("[VMM] Initializing Virtual Memory Manager...\n");
     
-    /* Clear frame bitmap */
-    for (int i = 0; i < MAX_FRAMES / 32; i++) {
-        frame_bitmap[i] = 0;
-    }
+    vmm_enable_paging_features();
     
-    /* Mark first 1MB + kernel as used */
-    uint32_t kernel_frames = 0x400000 / PAGE_SIZE;  /* 4MB for kernel */
-    for (uint32_t i = 0; i < kernel_frames; i++) {
-        uint32_t byte = i / 32;
-        uint32_t bit = i % 32;
-        frame_bitmap[byte] |= (1 << bit);
+#ifdef CONFIG_PAE
+    kernel_high_pd = (pte_t*)alloc_frame();
+    if (kernel_high_pd) {
+        for (uint32_t i = 0; i < PAGE_TABLE_ENTRIES; i++) {
+            kernel_high_pd[i] = 0;
+        }
     }
-    next_free_frame = kernel_frames;
+#endif
     
     /* Allocate kernel page directory */
-    uint32_t pd_phys = alloc_frame();
-    if (!pd_phys) {
+    kernel_page_directory = vmm_alloc_directory();
+    if (!kernel_page_directory) {
         kprintf("[VMM] Failed to allocate kernel page directory\n");
         return;
     }
     
-    kernel_page_directory = (uint32_t*)pd_phys;
+    current_page_directory = kernel_page_directory;
     
-    /* Clear page directory */
-    for (int i = 0; i < 1024; i++) {
-        kernel_page_directory[i] = 0;
+    /* Identity map all low memory so the kernel can reach any low-zone
+     * frame by its physical address. The map is identical in every
+     * address space, so it is global and, with PSE or PAE, made of large
+     * pages. */
+    uint32_t lowmem_pages = memory_get_max_pfn();
+    if (lowmem_pages > LOWMEM_END / PAGE_SIZE) {
+        lowmem_pages = LOWMEM_END / PAGE_SIZE;
+    }
+    kprintf("[VMM] Identity mapping low memory (0x00000000 - 0x%x)...\n",
+            lowmem_pages * PAGE_SIZE);
+    if (pse_enabled) {
+        uint32_t lowmem_end = lowmem_pages * PAGE_SIZE;
+        for (uint32_t addr = 0; addr < lowmem_end; addr += LARGE_PAGE_SIZE) {
+            *vmm_pde(kernel_page_directory, addr) =
+                addr | PAGE_PRESENT | PAGE_WRITE | PAGE_LARGE | global_flag;
+        }
+    } else {
+        for (uint32_t i = 0; i < lowmem_pages; i++) {
+            vmm_map_page(i * PAGE_SIZE, i * PAGE_SIZE, PAGE_PRESENT | PAGE_WRITE | PAGE_GLOBAL);
+        }
     }
     
-    current_page_directory = kernel_page_directory;
+    /* Pre-create the page tables covering the kernel heap window so every
+     * page directory copied from the kernel one shares them */
+    for (uint32_t addr = KHEAP_START; addr < KHEAP_END; addr += LARGE_PAGE_SIZE) {
+        vmm_get_page(addr, 1, &kernel_page_directory);
+    }
     
-    /* Identity map first 8MB (kernel space) */
-    kprintf("[VMM] Identity mapping kernel space (0x00000000 - 0x00800000)...\n");
-    for (uint32_t i = 0; i < 0x800000; i += PAGE_SIZE) {
-        vmm_map_page(i, i, PAGE_PRESENT | PAGE_WRITE);
+    /* Same for the kmap window; keep its table for direct PTE updates */
+    kmap_table = vmm_get_page(KMAP_START, 1, &kernel_page_directory);
+    for (uint32_t i = 0; i < KMAP_SLOTS / 32; i++) {
+        kmap_used[i] = 0;
     }
     
-    /* Enable paging */
+    /* Enable paging; WP makes kernel writes to read-only (COW) user
+     * pages fault too */
     kprintf("[VMM] Enabling paging...\n");
     __asm__ volatile(
-        "mov %0, %%cr3\n"  /* Load page directory */
+        "mov %0, %%cr3\n"  /* Load page directory (PDPT with PAE) */
         "mov %%cr0, %%eax\n"
-        "or $0x80000000, %%eax\n"  /* Set PG bit */
+        "or $0x80010000, %%eax\n"  /* Set PG and WP bits */
         "mov %%eax, %%cr0\n"
-        :: "r"(pd_phys)
+        :: "r"((uint32_t)kernel_page_directory + PDPT_OFFSET)
         : "eax"
     );
     
@@ -135,28 +287,34 @@ void vmm_init(void) {
 }
 
 /* Map virtual to physical address */
-void vmm_map_page(uint32_t virtual_addr, uint32_t physical_addr, uint32_t flags) {
-    uint32_t* page = vmm_get_page(virtual_addr, 1, &current_page_directory);
+void vmm_map_page(uint32_t virtual_addr, phys_addr_t physical_addr, uint32_t flags) {
+    pte_t* page = vmm_get_page(virtual_addr, 1, &current_page_directory);
     if (!page) {
         return;
     }
     
-    *page = (physical_addr & ~0xFFF) | (flags & 0xFFF) | PAGE_PRESENT;
+    *page = PTE_FRAME(physical_addr) | vmm_pte_flags(flags);
     
     /* Invalidate TLB entry */
     __asm__ volatile("invlpg (%0)" :: "r"(virtual_addr) : "memory");
 }
 
+/* Drop whatever a PTE holds: a frame reference or a swap slot */
+static void vmm_release_entry(pte_t entry) {
+    if (entry & PAGE_PRESENT) {
+        free_frame(PTE_FRAME(entry));
+    } else if (entry & PAGE_SWAPPED) {
+        swap_free(SWAP_SLOT(entry));
+    }
+}
+
 /* Unmap virtual address */
 void vmm_unmap_page(uint32_t virtual_addr) {
-    uint32_t* page = vmm_get_page(virtual_addr, 0, &current_page_directory);
+    pte_t* page = vmm_get_page(virtual_addr, 0, &current_page_directory);
     if (!page) return;
     
     /* Free the physical frame */
-    uint32_t phys = PAGE_GET_PHYSICAL_ADDRESS(page);
-    if (phys) {
-        free_frame(phys);
-    }
+    vmm_release_entry(*page);
     
     *page = 0;
     
@@ -164,9 +322,36 @@ void vmm_unmap_page(uint32_t virtual_addr) {
     __asm__ volatile("invlpg (%0)" :: "r"(virtual_addr) : "memory");
 }
 
+/* Raw PTE in the current address space */
+pte_t vmm_get_entry(uint32_t virtual_addr) {
+    pte_t* page = vmm_get_page(virtual_addr, 0, &current_page_directory);
+    return page ? *page : 0;
+}
+
+/* Page table of any address space (page tables live in low memory) */
+pte_t* vmm_get_page_table(uint32_t* pd, uint32_t virtual_addr) {
+    pte_t pde = *vmm_pde(pd, virtual_addr);
+    if (!(pde & PAGE_PRESENT) || (pde & PAGE_LARGE)) return NULL;
+    
+    return (pte_t*)(uint32_t)PTE_FRAME(pde);
+}
+
+/* Only the active address space can have the entry cached; the others
+ * lose their non-global entries when CR3 is loaded */
+void vmm_invalidate_page(uint32_t* pd, uint32_t virtual_addr) {
+    if (pd == current_page_directory) {
+        __asm__ volatile("invlpg (%0)" :: "r"(virtual_addr) : "memory");
+    }
+}
+
 /* Get physical address */
-uint32_t vmm_get_physical(uint32_t virtual_addr) {
-    uint32_t* page = vmm_get_page(virtual_addr, 0, &current_page_directory);
+phys_addr_t vmm_get_physical(uint32_t virtual_addr) {
+    pte_t pde = *vmm_pde(current_page_directory, virtual_addr);
+    if ((pde & (PAGE_PRESENT | PAGE_LARGE)) == (PAGE_PRESENT | PAGE_LARGE)) {
+        return (PTE_FRAME(pde) & ~(LARGE_PAGE_SIZE - 1)) | (virtual_addr & (LARGE_PAGE_SIZE - 1));
+    }
+    
+    pte_t* page = vmm_get_page(virtual_addr, 0, &current_page_directory);
     if (!page || !(*page & PAGE_PRESENT)) {
         return 0;
     }
@@ -174,23 +359,186 @@ uint32_t vmm_get_physical(uint32_t virtual_addr) {
     return PAGE_GET_PHYSICAL_ADDRESS(page) | (virtual_addr & 0xFFF);
 }
 
-/* Create page directory */
-uint32_t* vmm_create_page_directory(void) {
-    /* Allocate physical frame for page directory */
-    uint32_t pd_phys = alloc_frame();
-    if (!pd_phys) return NULL;
+/* Invalidate [start, end) after a batch of PTE updates: a few pages get
+ * individual invlpgs, larger ranges one full flush */
+static void vmm_flush_range(uint32_t start, uint32_t end) {
+    if ((end - start) / PAGE_SIZE <= VMM_INVLPG_MAX) {
+        for (uint32_t addr = start; addr < end; addr += PAGE_SIZE) {
+            __asm__ volatile("invlpg (%0)" :: "r"(addr) : "memory");
+        }
+    } else if (global_flag && (start < USER_SPACE_START || end > USER_SPACE_END)) {
+        vmm_flush_tlb_global();
+    } else {
+        vmm_flush_tlb();
+    }
+}
+
+/* Point every PTE in [start, end) at consecutive frames from 'frame' (or
+ * fresh ones if alloc is set). One page table walk per page table span,
+ * one TLB flush for the whole range; returns the address where mapping
+ * stopped. */
+static uint32_t vmm_fill_range(uint32_t start, uint32_t end, phys_addr_t frame,
+                               uint32_t flags, int alloc) {
+    uint32_t addr = start;
+    int stale = 0;
+    pte_t bits = vmm_pte_flags(flags);
+    
+    while (addr < end) {
+        pte_t* pte = vmm_get_page(addr, 1, &current_page_directory);
+        if (!pte) break;
+        
+        /* Run to the end of this page table or the range */
+        uint32_t table_end = (addr & ~(LARGE_PAGE_SIZE - 1)) + LARGE_PAGE_SIZE;
+        uint32_t run_end = (table_end - 1 < end - 1) ? table_end : end;
+        
+        for (; addr < run_end; addr += PAGE_SIZE, pte++) {
+            phys_addr_t phys = frame;
+            if (alloc) {
+                phys = pmm_alloc_pages(0, PMM_HIGHMEM);
+                if (!phys) break;
+            } else {
+                frame += PAGE_SIZE;
+            }
+            
+            if (*pte & PAGE_PRESENT) stale = 1;
+            *pte = phys | bits;
+        }
+        if (addr < run_end) break;
+    }
     
-    uint32_t* page_dir = (uint32_t*)pd_phys;
+    /* Not-present entries are never cached, only overwritten ones need a flush */
+    if (stale) {
+        vmm_flush_range(start, addr);
+    }
+    
+    return addr;
+}
+
+/* Clear PTEs of [start, end), optionally dropping the mapped frames;
+ * returns the number of present pages cleared */
+static uint32_t vmm_clear_range(uint32_t start, uint32_t end, int release) {
+    uint32_t addr = start;
+    uint32_t resident = 0;
     
-    /* Clear page directory */
-    for (int i = 0; i < 1024; i++) {
-        page_dir[i] = 0;
+    while (addr < end) {
+        uint32_t table_end = (addr & ~(LARGE_PAGE_SIZE - 1)) + LARGE_PAGE_SIZE;
+        uint32_t run_end = (table_end - 1 < end - 1) ? table_end : end;
+        
+        pte_t* pte = vmm_get_page(addr, 0, &current_page_directory);
+        if (pte) {
+            for (uint32_t a = addr; a < run_end; a += PAGE_SIZE, pte++) {
+                if (!*pte) continue;
+                if (*pte & PAGE_PRESENT) resident++;
+                if (release) {
+                    vmm_release_entry(*pte);
+                }
+                *pte = 0;
+            }
+        }
+        
+        addr = run_end;
+    }
+    
+    vmm_flush_range(start, end);
+    return resident;
+}
+
+/* Map a physically contiguous range */
+int vmm_map_range(uint32_t virtual_addr, uint32_t physical_addr, uint32_t size, uint32_t flags) {
+    uint32_t start = virtual_addr & ~0xFFF;
+    uint32_t end = (virtual_addr + size + 0xFFF) & ~0xFFF;
+    if (end <= start) return -1;
+    
+    uint32_t done = vmm_fill_range(start, end, physical_addr & ~0xFFF, flags, 0);
+    if (done < end) {
+        kprintf("[VMM] Failed to map 0x%x-0x%x\n", start, end);
+        vmm_clear_range(start, done, 0);
+        return -1;
+    }
+    
+    return 0;
+}
+
+/* Back a range with freshly allocated frames */
+int vmm_alloc_range(uint32_t virtual_addr, uint32_t size, uint32_t flags) {
+    uint32_t start = virtual_addr & ~0xFFF;
+    uint32_t end = (virtual_addr + size + 0xFFF) & ~0xFFF;
+    if (end <= start) return -1;
+    
+    uint32_t done = vmm_fill_range(start, end, 0, flags, 1);
+    if (done < end) {
+        vmm_clear_range(start, done, 1);
+        return -1;
+    }
+    
+    return 0;
+}
+
+/* Unmap a range, releasing its frames */
+uint32_t vmm_unmap_range(uint32_t virtual_addr, uint32_t size) {
+    uint32_t start = virtual_addr & ~0xFFF;
+    uint32_t end = (virtual_addr + size + 0xFFF) & ~0xFFF;
+    if (end <= start) return 0;
+    
+    return vmm_clear_range(start, end, 1);
+}
+
+/* Change the permissions of every present page in a range. Copy-on-write
+ * pages stay read-only until the next write fault breaks the sharing, and
+ * private user pages on frames that are not ours alone (shared by fork,
+ * or file pages mapped in place) become copy-on-write rather than
+ * writable. */
+void vmm_protect_range(uint32_t virtual_addr, uint32_t size, uint32_t flags) {
+    uint32_t start = virtual_addr & ~0xFFF;
+    uint32_t end = (virtual_addr + size + 0xFFF) & ~0xFFF;
+    if (end <= start) return;
+    
+    pte_t mask = PAGE_WRITE | PAGE_USER | PAGE_GLOBAL | nx_flag;
+    pte_t prot = vmm_pte_flags(flags) & mask;
+    
+    uint32_t addr = start;
+    while (addr < end) {
+        uint32_t table_end = (addr & ~(LARGE_PAGE_SIZE - 1)) + LARGE_PAGE_SIZE;
+        uint32_t run_end = (table_end - 1 < end - 1) ? table_end : end;
+        
+        pte_t* pte = vmm_get_page(addr, 0, &current_page_directory);
+        if (pte) {
+            for (uint32_t a = addr; a < run_end; a += PAGE_SIZE, pte++) {
+                if (!(*pte & PAGE_PRESENT)) continue;
+                
+                pte_t entry = (*pte & ~mask) | prot;
+                if ((entry & (PAGE_WRITE | PAGE_USER)) == (PAGE_WRITE | PAGE_USER) &&
+                    !(entry & PAGE_SHARED) &&
+                    pmm_get_refcount(PAGE_GET_PHYSICAL_ADDRESS(&entry)) != 1) {
+                    entry |= PAGE_COW;
+                }
+                if (entry & PAGE_COW) {
+                    entry &= ~PAGE_WRITE;
+                }
+                *pte = entry;
+            }
+        }
+        
+        addr = run_end;
     }
     
-    /* Copy kernel mappings (first 2GB) */
+    vmm_flush_range(start, end);
+}
+
+/* Create page directory */
+uint32_t* vmm_create_page_directory(void) {
+    uint32_t* page_dir = vmm_alloc_directory();
+    if (!page_dir) return NULL;
+    
+    /* Share kernel mappings (everything outside user space; with PAE the
+     * top 1GB already is, through kernel_high_pd) */
     if (kernel_page_directory) {
-        for (int i = 0; i < 512; i++) {
-            page_dir[i] = kernel_page_directory[i];
+        pte_t* dst = (pte_t*)page_dir;
+        pte_t* src = (pte_t*)kernel_page_directory;
+        for (uint32_t i = 0; i < PD_ENTRIES; i++) {
+            if (i < USER_PDE_START || i >= USER_PDE_END) {
+                dst[i] = src[i];
+            }
         }
     }
     
@@ -204,7 +552,7 @@ void vmm_switch_page_directory(uint32_t* page_directory) {
     current_page_directory = page_directory;
     
     /* Load CR3 register with physical address of page directory */
-    __asm__ volatile("mov %0, %%cr3" :: "r"(page_directory));
+    __asm__ volatile("mov %0, %%cr3" :: "r"((uint32_t)page_directory + PDPT_OFFSET));
 }
 
 /* Get current page directory */
@@ -212,55 +560,268 @@ uint32_t* vmm_get_page_directory(void) {
     return current_page_directory;
 }
 
-/* Clone page directory for fork */
-uint32_t* vmm_clone_page_directory(uint32_t* src) {
-    if (!src) return NULL;
+/* Drop every user mapping of a page directory and free its user page
+ * tables; returns how many frames went back to the allocator */
+uint32_t vmm_clear_user_space(uint32_t* page_directory) {
+    pte_t* pd = (pte_t*)page_directory;
+    uint32_t reclaimed = 0;
+    
+    for (uint32_t i = USER_PDE_START; i < USER_PDE_END; i++) {
+        if (!(pd[i] & PAGE_PRESENT)) continue;
+        
+        pte_t* pt = (pte_t*)(uint32_t)PAGE_GET_PHYSICAL_ADDRESS(&pd[i]);
+        for (uint32_t j = 0; j < PAGE_TABLE_ENTRIES; j++) {
+            if (!(pt[j] & PAGE_PRESENT)) {
+                vmm_release_entry(pt[j]);
+                continue;
+            }
+            
+            /* Frames still shared copy-on-write only lose a reference */
+            phys_addr_t frame = PAGE_GET_PHYSICAL_ADDRESS(&pt[j]);
+            if (pmm_get_refcount(frame) == 1) {
+                reclaimed++;
+            }
+            free_frame(frame);
+        }
+        
+        free_frame((uint32_t)pt);
+        reclaimed++;
+        pd[i] = 0;
+    }
+    
+    if (page_directory == current_page_directory) {
+        vmm_flush_tlb();
+    }
+    
+    return reclaimed;
+}
+
+/* Tear down an address space completely, page directory included */
+uint32_t vmm_destroy_address_space(uint32_t* pd) {
+    if (!pd || pd == kernel_page_directory) return 0;
+    
+    /* Never free the directory we are running on */
+    if (pd == current_page_directory) {
+        vmm_switch_page_directory(kernel_page_directory);
+    }
     
-    uint32_t* new_pd = vmm_create_page_directory();
-    if (!new_pd) return NULL;
+    uint32_t reclaimed = vmm_clear_user_space(pd);
+    pmm_free_pages((uint32_t)pd, PD_BLOCK_ORDER);
     
-    /* Copy user space page directory entries (512-1024) */
-    for (int i = 512; i < 1024; i++) {
+    return reclaimed + (1 << PD_BLOCK_ORDER);
+}
+
+/* Clone page directory for fork: user pages are shared copy-on-write */
+uint32_t* vmm_clone_page_directory(uint32_t* src_pd) {
+    if (!src_pd) return NULL;
+    
+    uint32_t* new_pd_handle = vmm_create_page_directory();
+    if (!new_pd_handle) return NULL;
+    
+    pte_t* src = (pte_t*)src_pd;
+    pte_t* new_pd = (pte_t*)new_pd_handle;
+    
+    /* Copy user space page tables; the pages themselves stay shared */
+    for (uint32_t i = USER_PDE_START; i < USER_PDE_END; i++) {
         if (!(src[i] & PAGE_PRESENT)) continue;
         
         /* Get source page table */
-        uint32_t* src_pt = (uint32_t*)PAGE_GET_PHYSICAL_ADDRESS(&src[i]);
+        pte_t* src_pt = (pte_t*)(uint32_t)PAGE_GET_PHYSICAL_ADDRESS(&src[i]);
         
         /* Allocate new page table */
         uint32_t pt_phys = alloc_frame();
-        if (!pt_phys) continue;
+        if (!pt_phys) {
+            kprintf("[VMM] Out of memory cloning address space\n");
+            vmm_destroy_address_space(new_pd_handle);
+            if (src_pd == current_page_directory) {
+                vmm_flush_tlb();
+            }
+            return NULL;
+        }
         
-        uint32_t* new_pt = (uint32_t*)pt_phys;
+        pte_t* new_pt = (pte_t*)pt_phys;
         
         /* Copy page table entries */
-        for (int j = 0; j < 1024; j++) {
-            if (!(src_pt[j] & PAGE_PRESENT)) {
-                new_pt[j] = 0;
-                continue;
-            }
+        for (uint32_t j = 0; j < PAGE_TABLE_ENTRIES; j++) {
+            pte_t entry = src_pt[j];
             
-            /* Allocate new physical frame */
-            uint32_t new_frame = alloc_frame();
-            if (!new_frame) {
-                new_pt[j] = 0;
+            if (!(entry & PAGE_PRESENT)) {
+                /* Swapped-out pages share the slot */
+                if (entry & PAGE_SWAPPED) {
+                    swap_dup(SWAP_SLOT(entry));
+                }
+                new_pt[j] = entry;
                 continue;
             }
             
-            /* Copy page contents */
-            uint32_t* src_page = (uint32_t*)PAGE_GET_PHYSICAL_ADDRESS(&src_pt[j]);
-            uint32_t* dst_page = (uint32_t*)new_frame;
-            
-            for (int k = 0; k < 1024; k++) {
-                dst_page[k] = src_page[k];
+            /* Writable pages become read-only + COW in both spaces,
+             * shared memory stays shared */
+            if ((entry & (PAGE_WRITE | PAGE_COW)) && !(entry & PAGE_SHARED)) {
+                entry = (entry & ~PAGE_WRITE) | PAGE_COW;
+                src_pt[j] = entry;
             }
             
-            /* Set up new page table entry */
-            new_pt[j] = new_frame | (src_pt[j] & 0xFFF);
+            pmm_ref_frame(PAGE_GET_PHYSICAL_ADDRESS(&entry));
+            new_pt[j] = entry;
         }
         
         /* Set up new page directory entry */
         new_pd[i] = pt_phys | (src[i] & 0xFFF);
     }
     
-    return new_pd;
-}
\ No newline at end of file
+    /* Parent lost write access to its pages */
+    if (src_pd == current_page_directory) {
+        vmm_flush_tlb();
+    }
+    
+    return new_pd_handle;
+}
+
+/* Give the faulting address space a private, writable copy of a COW page */
+static int vmm_break_cow(uint32_t virtual_addr, pte_t* page) {
+    phys_addr_t old_frame = PAGE_GET_PHYSICAL_ADDRESS(page);
+    pte_t flags = (*page & ~PTE_ADDR_MASK & ~PAGE_COW) | PAGE_WRITE;
+    
+    if (pmm_get_refcount(old_frame) == 1) {
+        /* Last reference: take the frame over */
+        *page = old_frame | flags;
+    } else {
+        phys_addr_t new_frame = pmm_alloc_pages(0, PMM_HIGHMEM);
+        if (!new_frame && swap_reclaim(SWAP_CLUSTER)) {
+            new_frame = pmm_alloc_pages(0, PMM_HIGHMEM);
+        }
+        if (!new_frame) {
+            kprintf("[VMM] Out of memory breaking COW at 0x%x\n", virtual_addr);
+            return -1;
+        }
+        
+        vmm_copy_frame(new_frame, old_frame);
+        *page = new_frame | flags;
+        free_frame(old_frame);
+    }
+    
+    __asm__ volatile("invlpg (%0)" :: "r"(virtual_addr) : "memory");
+    
+    return 0;
+}
+
+/* Handle page fault, returns 0 if resolved */
+int vmm_handle_page_fault(uint32_t fault_addr, uint32_t error_code) {
+    /* Write to a present page: copy-on-write candidate */
+    if ((error_code & (PF_PRESENT | PF_WRITE)) == (PF_PRESENT | PF_WRITE)) {
+        pte_t* page = vmm_get_page(fault_addr, 0, NULL);
+        if (page && (*page & PAGE_PRESENT) && (*page & PAGE_COW)) {
+            return vmm_break_cow(fault_addr & ~0xFFF, page);
+        }
+    }
+    
+    return -1;
+}
+
+/* Flush all non-global TLB entries */
+void vmm_flush_tlb(void) {
+    __asm__ volatile(
+        "mov %%cr3, %%eax\n"
+        "mov %%eax, %%cr3\n"
+        ::: "eax", "memory"
+    );
+}
+
+/* Map a physical frame into kernel space */
+void* vmm_kmap(phys_addr_t physical_addr) {
+    if (physical_addr < LOWMEM_END) {
+        return (void*)(uint32_t)physical_addr;
+    }
+    
+    for (uint32_t n = 0; n < KMAP_SLOTS; n++) {
+        uint32_t slot = (kmap_next + n) % KMAP_SLOTS;
+        if (kmap_used[slot / 32] & (1 << (slot % 32))) continue;
+        
+        kmap_used[slot / 32] |= 1 << (slot % 32);
+        kmap_next = (slot + 1) % KMAP_SLOTS;
+        
+        uint32_t virtual_addr = KMAP_START + slot * PAGE_SIZE;
+        kmap_table[slot] = PTE_FRAME(physical_addr) | PAGE_PRESENT | PAGE_WRITE | global_flag;
+        __asm__ volatile("invlpg (%0)" :: "r"(virtual_addr) : "memory");
+        
+        return (void*)(virtual_addr | ((uint32_t)physical_addr & 0xFFF));
+    }
+    
+    kprintf("[VMM] kmap window exhausted\n");
+    return NULL;
+}
+
+/* Release a mapping from vmm_kmap */
+void vmm_kunmap(void* addr) {
+    uint32_t virtual_addr = (uint32_t)addr & ~0xFFF;
+    if (virtual_addr < KMAP_START || virtual_addr >= KMAP_END) return;
+    
+    uint32_t slot = (virtual_addr - KMAP_START) / PAGE_SIZE;
+    kmap_table[slot] = 0;
+    kmap_used[slot / 32] &= ~(1 << (slot % 32));
+    __asm__ volatile("invlpg (%0)" :: "r"(virtual_addr) : "memory");
+}
+
+/* Copy kernel data into a possibly inactive address space */
+int vmm_copy_to_space(uint32_t* pd, uint32_t virtual_addr,
+                      const void* src, uint32_t size, uint32_t flags) {
+    const uint8_t* from = (const uint8_t*)src;
+    int mapped = 0;
+    
+    while (size > 0) {
+        uint32_t offset = virtual_addr & 0xFFF;
+        uint32_t chunk = PAGE_SIZE - offset;
+        if (chunk > size) chunk = size;
+        
+        pte_t* pte = vmm_get_page(virtual_addr, 1, &pd);
+        if (!pte) return -1;
+        
+        /* Not-present entries are never cached, no flush needed */
+        if (!(*pte & PAGE_PRESENT)) {
+            phys_addr_t frame = alloc_zeroed_frame();
+            if (!frame) return -1;
+            *pte = frame | vmm_pte_flags(flags);
+            mapped++;
+        }
+        
+        uint8_t* page = (uint8_t*)vmm_kmap(PTE_FRAME(*pte));
+        if (!page) return -1;
+        
+        uint8_t* dst = page + offset;
+        uint32_t count = chunk;
+        __asm__ volatile("rep movsb" : "+D"(dst), "+S"(from), "+c"(count) :: "memory");
+        vmm_kunmap(page);
+        
+        virtual_addr += chunk;
+        size -= chunk;
+    }
+    
+    return mapped;
+}
+
+/* Copy one physical frame to another */
+void vmm_copy_frame(phys_addr_t dst_phys, phys_addr_t src_phys) {
+    uint32_t* dst = (uint32_t*)vmm_kmap(dst_phys);
+    uint32_t* src = (uint32_t*)vmm_kmap(src_phys);
+    
+    if (dst && src) {
+        for (int i = 0; i < 1024; i++) {
+            dst[i] = src[i];
+        }
+    }
+    
+    vmm_kunmap(src);
+    vmm_kunmap(dst);
+}
+
+/* Fill a physical frame with zeros */
+void vmm_zero_frame(phys_addr_t physical_addr) {
+    uint32_t* page = (uint32_t*)vmm_kmap(physical_addr);
+    if (!page) return;
+    
+    uint32_t* dst = page;
+    uint32_t count = PAGE_SIZE / 4;
+    __asm__ volatile("rep stosl" : "+D"(dst), "+c"(count) : "a"(0) : "memory");
+    
+    vmm_kunmap(page);
+}
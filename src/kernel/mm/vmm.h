@@ -4,28 +4,101 @@
 #define VMM_H
 
 #include <stdint.h>
+#include "pmm.h"
 
 /* Page flags */
 #define PAGE_PRESENT   0x1
 #define PAGE_WRITE     0x2
 #define PAGE_USER      0x4
+#define PAGE_ACCESSED  0x20           /* Set by the CPU on any access */
+#define PAGE_LARGE     0x80           /* PDE maps a 4MB page (PSE), 2MB with PAE */
+#define PAGE_GLOBAL    0x100          /* Kept in the TLB across CR3 loads (PGE) */
+#define PAGE_COW       0x200          /* Available bit: shared copy-on-write */
+#define PAGE_SHARED    0x400          /* Available bit: deliberately shared, never COW */
+#define PAGE_SWAPPED   0x800          /* Not present: contents in a swap slot (see swap.h) */
+#define PAGE_NOEXEC    0x80000000     /* Mapping flag only: no instruction fetch (needs PAE + NX) */
+
+/* Page table entries: 32-bit with two-level paging, 64-bit with PAE
+ * (build with PAE=1), where bits 12-51 hold the frame and bit 63 is NX */
+#ifdef CONFIG_PAE
+typedef uint64_t pte_t;
+#define PDE_SHIFT      21
+#define PTE_ADDR_MASK  0x000FFFFFFFFFF000ULL
+#else
+typedef uint32_t pte_t;
+#define PDE_SHIFT      22
+#define PTE_ADDR_MASK  0xFFFFF000
+#endif
+#define PAGE_TABLE_ENTRIES (PAGE_SIZE / sizeof(pte_t))
+#define PTE_FRAME(entry) ((phys_addr_t)((entry) & PTE_ADDR_MASK))
+
+/* Page fault error code bits */
+#define PF_PRESENT     0x1            /* Protection violation (page present) */
+#define PF_WRITE       0x2
+#define PF_USER        0x4
+#define PF_FETCH       0x10           /* Instruction fetch (reported with NX only) */
 
 /* Page size */
 #define PAGE_SIZE 4096
+#define LARGE_PAGE_SIZE (1 << PDE_SHIFT)   /* Span of one page table */
+
+/* Kernel virtual address space layout */
+#define LOWMEM_END     0x0C000000     /* Physical memory identity-mapped below this */
+#define KHEAP_START    0x0C000000     /* Kernel heap window (64MB) */
+#define KHEAP_END      0x10000000
+#define USER_SPACE_START 0x10000000   /* Per-process user mappings */
+#define USER_SPACE_END   0xC0000000
+#define KMAP_START     0xFF800000     /* Temporary mappings of high frames */
+#define KMAP_END       (KMAP_START + LARGE_PAGE_SIZE)
+
+/* Page directory index range private to each address space */
+#define USER_PDE_START (USER_SPACE_START >> PDE_SHIFT)
+#define USER_PDE_END   (USER_SPACE_END >> PDE_SHIFT)
 
 /* Initialize virtual memory */
 void vmm_init(void);
 
 /* Map virtual address to physical address */
-void vmm_map_page(uint32_t virtual_addr, uint32_t physical_addr, uint32_t flags);
+void vmm_map_page(uint32_t virtual_addr, phys_addr_t physical_addr, uint32_t flags);
 
 /* Unmap virtual address */
 void vmm_unmap_page(uint32_t virtual_addr);
 
+/* Range operations: each page table is walked once and the TLB is
+ * flushed once per call. Addresses are rounded out to whole pages. */
+
+/* Map [virtual_addr, +size) to physically contiguous frames (0 on success) */
+int vmm_map_range(uint32_t virtual_addr, uint32_t physical_addr, uint32_t size, uint32_t flags);
+
+/* Map [virtual_addr, +size) to freshly allocated frames (0 on success,
+ * nothing stays mapped on failure) */
+int vmm_alloc_range(uint32_t virtual_addr, uint32_t size, uint32_t flags);
+
+/* Unmap [virtual_addr, +size), dropping a reference to each frame (and
+ * swap slot); returns how many resident pages were unmapped */
+uint32_t vmm_unmap_range(uint32_t virtual_addr, uint32_t size);
+
+/* Replace PAGE_WRITE/PAGE_USER/PAGE_GLOBAL/PAGE_NOEXEC on the present
+ * pages of a range */
+void vmm_protect_range(uint32_t virtual_addr, uint32_t size, uint32_t flags);
+
+/* Raw PTE of a page in the current address space (0 if it has no table) */
+pte_t vmm_get_entry(uint32_t virtual_addr);
+
+/* Page table covering virtual_addr in any address space (NULL if none) */
+pte_t* vmm_get_page_table(uint32_t* page_directory, uint32_t virtual_addr);
+
+/* Drop a stale TLB entry after editing a PTE of page_directory */
+void vmm_invalidate_page(uint32_t* page_directory, uint32_t virtual_addr);
+
 /* Get physical address from virtual address */
-uint32_t vmm_get_physical(uint32_t virtual_addr);
+phys_addr_t vmm_get_physical(uint32_t virtual_addr);
 
-/* Create new page directory */
+/* Create new page directory. The handle addresses the top-level table
+ * as an array of pte_t indexed by virtual_addr >> PDE_SHIFT; with PAE
+ * that is three page directories laid out back to back (the fourth, for
+ * the top 1GB, is shared by every address space), followed by the PDPT
+ * that CR3 actually points at. */
 uint32_t* vmm_create_page_directory(void);
 
 /* Switch page directory */
@@ -34,4 +107,39 @@ void vmm_switch_page_directory(uint32_t* page_directory);
 /* Get current page directory */
 uint32_t* vmm_get_page_directory(void);
 
+/* Clone address space for fork (user pages shared copy-on-write) */
+uint32_t* vmm_clone_page_directory(uint32_t* src);
+
+/* Unmap and release all user pages and page tables of an address space.
+ * Returns the number of frames actually freed (shared COW frames only
+ * lose a reference). */
+uint32_t vmm_clear_user_space(uint32_t* page_directory);
+
+/* Release an address space and its page directory (switching to the
+ * kernel directory first if it is active). Returns frames freed. */
+uint32_t vmm_destroy_address_space(uint32_t* page_directory);
+
+/* Resolve a page fault (returns 0 if handled, -1 if fatal) */
+int vmm_handle_page_fault(uint32_t fault_addr, uint32_t error_code);
+
+/* Flush all non-global TLB entries */
+void vmm_flush_tlb(void);
+
+/* Temporarily map a physical frame for kernel access (direct-mapped
+ * frames are returned as is). Release with vmm_kunmap. */
+void* vmm_kmap(phys_addr_t physical_addr);
+void vmm_kunmap(void* addr);
+
+/* Copy size bytes from kernel memory to virtual_addr in any address
+ * space, backing not-present pages with zeroed frames mapped with flags.
+ * Present pages are written in place, so the range must not hold
+ * copy-on-write or swapped pages. Returns the number of frames mapped,
+ * -1 when out of memory. */
+int vmm_copy_to_space(uint32_t* page_directory, uint32_t virtual_addr,
+                      const void* src, uint32_t size, uint32_t flags);
+
+/* Copy or clear a whole physical frame */
+void vmm_copy_frame(phys_addr_t dst_phys, phys_addr_t src_phys);
+void vmm_zero_frame(phys_addr_t physical_addr);
+
 #endif /* VMM_H */
\ No newline at end of file
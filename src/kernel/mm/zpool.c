@@ -0,0 +1,61 @@
+/* zpool.c - Pool of pre-zeroed page frames
+ *
+ * Demand-zero faults and new shared segments need frames full of zeros.
+ * Rather than clearing them on the fault path, the scheduler's idle loop
+ * calls zpool_refill() before halting, which zeroes a few frames at a
+ * time into a small stack. alloc_zeroed_frame() pops from the stack and
+ * only falls back to zeroing synchronously when it is empty.
+ * Refilling stops while free memory is below ZPOOL_RESERVE pages so the
+ * pool never competes with real allocations. When memory runs out
+ * altogether, cold user pages are pushed out to swap to make room.
+ */
+
+#include "zpool.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "swap.h"
+
+static phys_addr_t pool[ZPOOL_CAPACITY];
+static uint32_t pool_count = 0;
+static uint32_t pool_hits = 0;
+static uint32_t pool_misses = 0;
+
+/* Allocate a zero-filled frame */
+phys_addr_t alloc_zeroed_frame(void) {
+    if (pool_count > 0) {
+        pool_hits++;
+        return pool[--pool_count];
+    }
+
+    pool_misses++;
+    phys_addr_t frame = pmm_alloc_pages(0, PMM_HIGHMEM);
+    if (!frame && swap_reclaim(SWAP_CLUSTER)) {
+        frame = pmm_alloc_pages(0, PMM_HIGHMEM);
+    }
+    if (frame) {
+        vmm_zero_frame(frame);
+    }
+    return frame;
+}
+
+/* Zero a batch of frames into the pool */
+void zpool_refill(void) {
+    for (int i = 0; i < ZPOOL_BATCH && pool_count < ZPOOL_CAPACITY; i++) {
+        if (pmm_get_free_pages(PMM_ZONE_ALL) < ZPOOL_RESERVE) return;
+
+        phys_addr_t frame = pmm_alloc_pages(0, PMM_HIGHMEM);
+        if (!frame) return;
+
+        /* Only publish the frame once it is fully cleared */
+        vmm_zero_frame(frame);
+        pool[pool_count++] = frame;
+    }
+}
+
+/* Pool statistics */
+void zpool_get_stats(zpool_stats_t* stats) {
+    stats->count = pool_count;
+    stats->capacity = ZPOOL_CAPACITY;
+    stats->hits = pool_hits;
+    stats->misses = pool_misses;
+}
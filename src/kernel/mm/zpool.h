@@ -0,0 +1,31 @@
+/* zpool.h - Pool of pre-zeroed page frames */
+
+#ifndef ZPOOL_H
+#define ZPOOL_H
+
+#include <stdint.h>
+#include "pmm.h"
+
+#define ZPOOL_CAPACITY  64          /* Frames kept ready (256KB) */
+#define ZPOOL_BATCH     4           /* Frames zeroed per idle call */
+#define ZPOOL_RESERVE   1024        /* Free pages left alone for other users */
+
+typedef struct {
+    uint32_t count;                 /* Frames ready now */
+    uint32_t capacity;
+    uint32_t hits;                  /* Requests served from the pool */
+    uint32_t misses;                /* Requests zeroed on the spot */
+} zpool_stats_t;
+
+/* Allocate a zero-filled frame (may be high memory, reach it through
+ * vmm_kmap). Returns 0 when out of memory. */
+phys_addr_t alloc_zeroed_frame(void);
+
+/* Zero up to ZPOOL_BATCH frames into the pool; call when the CPU would
+ * otherwise halt */
+void zpool_refill(void);
+
+/* Pool occupancy and hit/miss counters */
+void zpool_get_stats(zpool_stats_t* stats);
+
+#endif /* ZPOOL_H */
@@ -2,25 +2,10 @@
 
 #include "elf.h"
 #include "../fs/vfs.h"
-#include "../mm/heap.h"
 #include "../mm/vmm.h"
+#include "../mm/region.h"
 #include "../core/console.h"
 
-/* Memory copy helper */
-static void* memcpy(void* dest, const void* src, size_t n) {
-    uint8_t* d = dest;
-    const uint8_t* s = src;
-    while (n--) *d++ = *s++;
-    return dest;
-}
-
-/* Memory set helper */
-static void* memset(void* s, int c, size_t n) {
-    uint8_t* p = s;
-    while (n--) *p++ = (uint8_t)c;
-    return s;
-}
-
 /* Validate ELF header */
 int elf_validate(elf_header_t* header) {
     if (!header) return 0;
@@ -57,7 +42,7 @@ int elf_validate(elf_header_t* header) {
 }
 
 /* Load ELF binary from file */
-uint32_t elf_load(const char* path) {
+uint32_t elf_load(const char* path, struct vm_region** regions, elf_info_t* info) {
     /* Open file */
     int fd = vfs_open(path, 0);
     if (fd < 0) {
@@ -80,11 +65,20 @@ uint32_t elf_load(const char* path) {
         return 0;
     }
     
+    /* Segments are paged in straight from the file node */
+    vfs_node_t* node = vfs_get_node(fd);
+    
     /* Read program headers */
     uint32_t phoff = header.e_phoff;
     uint16_t phnum = header.e_phnum;
     uint16_t phentsize = header.e_phentsize;
     
+    if (info) {
+        info->phdr = 0;
+        info->phent = phentsize;
+        info->phnum = phnum;
+    }
+    
     for (int i = 0; i < phnum; i++) {
         elf_program_header_t phdr;
         
@@ -102,27 +96,35 @@ uint32_t elf_load(const char* path) {
             continue;
         }
         
-        /* Allocate memory for segment */
-        void* segment = (void*)phdr.p_vaddr;
-        
-        /* TODO: Map pages for segment in virtual memory */
-        /* For now, just use physical addresses */
+        /* Segment must lie inside user space */
+        if (phdr.p_memsz < phdr.p_filesz ||
+            phdr.p_vaddr < USER_SPACE_START ||
+            phdr.p_memsz > USER_SPACE_END - phdr.p_vaddr) {
+            kprintf("[ELF] Segment %d outside user space\n", i);
+            vfs_close(fd);
+            return 0;
+        }
         
-        /* Seek to segment data */
-        vfs_seek(fd, phdr.p_offset, 0);
+        if (phdr.p_memsz == 0) {
+            continue;
+        }
         
-        /* Read segment data */
-        if (phdr.p_filesz > 0) {
-            if (vfs_read(fd, segment, phdr.p_filesz) != (int)phdr.p_filesz) {
-                kprintf("[ELF] Failed to read segment %d\n", i);
-                continue;
-            }
+        /* The header table is visible to the program if a segment maps it */
+        if (info && phoff >= phdr.p_offset &&
+            phoff + (uint32_t)phnum * phentsize <= phdr.p_offset + phdr.p_filesz) {
+            info->phdr = phdr.p_vaddr + (phoff - phdr.p_offset);
         }
         
-        /* Zero remaining memory if memsz > filesz (BSS) */
-        if (phdr.p_memsz > phdr.p_filesz) {
-            memset((uint8_t*)segment + phdr.p_filesz, 0, 
-                   phdr.p_memsz - phdr.p_filesz);
+        uint32_t flags = REGION_READ;
+        if (phdr.p_flags & PF_W) flags |= REGION_WRITE;
+        if (phdr.p_flags & PF_X) flags |= REGION_EXEC;
+        
+        /* Record the segment; pages are read in on first touch */
+        if (!region_add(regions, phdr.p_vaddr, phdr.p_vaddr + phdr.p_memsz, flags,
+                        node, phdr.p_offset, phdr.p_filesz)) {
+            kprintf("[ELF] Failed to add region for segment %d\n", i);
+            vfs_close(fd);
+            return 0;
         }
     }
     
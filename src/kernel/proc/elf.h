@@ -44,9 +44,35 @@ typedef struct {
 #define PT_DYNAMIC 2
 #define PT_INTERP  3
 #define PT_NOTE    4
+#define PT_PHDR    6
 
-/* Load ELF binary from file and return entry point */
-uint32_t elf_load(const char* path);
+/* Segment permission flags */
+#define PF_X       0x1
+#define PF_W       0x2
+#define PF_R       0x4
+
+/* Auxiliary vector entry types passed to a new image (must match libsys.h) */
+#define AT_NULL    0         /* End of vector */
+#define AT_PHDR    3         /* Program headers in memory */
+#define AT_PHENT   4         /* Size of one program header */
+#define AT_PHNUM   5         /* Number of program headers */
+#define AT_PAGESZ  6         /* Page size */
+#define AT_ENTRY   9         /* Entry point */
+#define AT_CLKTCK  17        /* Timer ticks per second */
+
+/* Where a loaded image finds its own program headers */
+typedef struct {
+    uint32_t phdr;           /* Address of the table, 0 if not mapped */
+    uint32_t phent;
+    uint32_t phnum;
+} elf_info_t;
+
+struct vm_region;
+
+/* Describe an ELF binary's segments as demand-paged regions and return
+ * its entry point (0 on failure). info, if not NULL, receives the
+ * program header location. */
+uint32_t elf_load(const char* path, struct vm_region** regions, elf_info_t* info);
 
 /* Validate ELF header */
 int elf_validate(elf_header_t* header);
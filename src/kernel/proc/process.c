@@ -1,26 +1,51 @@
 /* process.c - Complete Process Management Implementation */
 
 #include "process.h"
+#include "scheduler.h"
 #include "elf.h"
 #include "../mm/heap.h"
+#include "../mm/slab.h"
 #include "../mm/vmm.h"
+#include "../mm/region.h"
+#include "../mm/shm.h"
 #include "../core/timer.h"
 #include "../core/console.h"
+#include "../core/gdt.h"
+#include "../core/isr.h"
 #include "../fs/vfs.h"
 
-#define MAX_PROCESSES 64
+#define MAX_PROCESSES 256
+#define PID_MAX 4096                /* PIDs are recycled below this */
+#define PID_HASH_SIZE 64
 #define KERNEL_STACK_SIZE 8192
 #define USER_STACK_SIZE 8192
 #define USER_STACK_TOP 0xC0000000
 #define MAX_FD_PER_PROCESS 32
+#define EXEC_ARGS_MAX 4096          /* Bytes of startup data on a new stack */
+#define EXEC_AUX_COUNT 7            /* auxv entries, AT_NULL included */
 
-static process_t* process_list = NULL;
 static process_t* current_process = NULL;
-static uint32_t next_pid = 1;
 
-/* Context switch assembly helpers */
+/* Every process, zombies included, packed at the front of one array */
+static process_t* process_table[MAX_PROCESSES];
+static uint32_t process_total = 0;
+
+/* PID lookup and allocation: the bitmap hands out the next free PID
+ * after the last one, wrapping at PID_MAX */
+static process_t* pid_hash[PID_HASH_SIZE];
+static uint32_t pid_bitmap[PID_MAX / 32];
+static uint32_t last_pid = PID_MAX - 1;     /* The first process gets PID 0 */
+
+/* Object caches for process structures and fd tables */
+static kmem_cache_t* process_cache = NULL;
+static kmem_cache_t* fd_table_cache = NULL;
+
+/* Save the callee-saved registers on the current kernel stack, store
+ * the stack pointer in *old_esp and resume the stack at new_esp */
 extern void switch_context(uint32_t* old_esp, uint32_t new_esp);
-extern void enter_usermode(uint32_t eip, uint32_t esp);
+
+/* Entry of a new kernel thread: calls ebx(esi), then kthread_exit */
+extern void kthread_start(void);
 
 /* String utilities */
 static char* strncpy(char* dest, const char* src, size_t n) {
@@ -55,61 +80,276 @@ static size_t strlen(const char* s) {
     return len;
 }
 
+/* Constructor for fd table cache: tables are handed out empty */
+static void fd_table_ctor(void* obj) {
+    memset(obj, 0, sizeof(struct vfs_node*) * MAX_FD_PER_PROCESS);
+}
+
 /* Initialize process management */
 void process_init(void) {
     kprintf("[PROC] Initializing process management...\n");
-    process_list = NULL;
+    
+    process_cache = kmem_cache_create("process", sizeof(process_t), 0, NULL);
+    region_init();
+    fd_table_cache = kmem_cache_create("fd_table",
+                                       sizeof(struct vfs_node*) * MAX_FD_PER_PROCESS,
+                                       0, fd_table_ctor);
+    
     current_process = NULL;
-    next_pid = 1;
     
     /* Create kernel process (PID 0) */
     process_t* kernel_proc = process_create("kernel");
     if (kernel_proc) {
-        kernel_proc->pid = 0;
         kernel_proc->state = PROCESS_RUNNING;
+        vmm_destroy_address_space(kernel_proc->page_directory);
         kernel_proc->page_directory = vmm_get_page_directory();
+        kfree(kernel_proc->kernel_stack);      /* Runs on the boot stack */
+        kernel_proc->kernel_stack = NULL;
         current_process = kernel_proc;
         kprintf("[PROC] Kernel process created (PID 0)\n");
     }
 }
 
+/* Claim the next free PID; -1 if all are taken */
+static int pid_alloc(void) {
+    for (uint32_t n = 1; n <= PID_MAX; n++) {
+        uint32_t pid = (last_pid + n) % PID_MAX;
+        if (!(pid_bitmap[pid / 32] & (1U << (pid % 32)))) {
+            pid_bitmap[pid / 32] |= 1U << (pid % 32);
+            last_pid = pid;
+            return (int)pid;
+        }
+    }
+    return -1;
+}
+
+/* Insert a process at the head of a children or zombies list */
+static void sibling_insert(process_t** list, process_t* proc) {
+    proc->sibling_prev = NULL;
+    proc->sibling_next = *list;
+    if (*list) {
+        (*list)->sibling_prev = proc;
+    }
+    *list = proc;
+}
+
+/* Unlink a process from a children or zombies list */
+static void sibling_remove(process_t** list, process_t* proc) {
+    if (proc->sibling_prev) {
+        proc->sibling_prev->sibling_next = proc->sibling_next;
+    } else {
+        *list = proc->sibling_next;
+    }
+    if (proc->sibling_next) {
+        proc->sibling_next->sibling_prev = proc->sibling_prev;
+    }
+    proc->sibling_next = NULL;
+    proc->sibling_prev = NULL;
+}
+
+static void process_reap_orphans(void);
+
+/* Give a process a PID and enter it into the table, the PID hash and
+ * its parent's children */
+static int process_register(process_t* proc, process_t* parent) {
+    process_reap_orphans();
+    if (process_total >= MAX_PROCESSES) return -1;
+    
+    int pid = pid_alloc();
+    if (pid < 0) return -1;
+    
+    proc->pid = (uint32_t)pid;
+    proc->parent = parent;
+    proc->parent_pid = parent ? parent->pid : 0;
+    if (parent) {
+        sibling_insert(&parent->children, proc);
+    }
+    
+    proc->hash_next = pid_hash[pid % PID_HASH_SIZE];
+    pid_hash[pid % PID_HASH_SIZE] = proc;
+    
+    proc->table_index = process_total;
+    process_table[process_total++] = proc;
+    return 0;
+}
+
+/* Undo process_register */
+static void process_unregister(process_t* proc) {
+    if (proc->table_index >= process_total || process_table[proc->table_index] != proc) {
+        return;
+    }
+    
+    /* Keep the table packed by moving the last entry into the hole */
+    process_t* last = process_table[--process_total];
+    process_table[proc->table_index] = last;
+    last->table_index = proc->table_index;
+    
+    process_t** link = &pid_hash[proc->pid % PID_HASH_SIZE];
+    while (*link != proc) {
+        link = &(*link)->hash_next;
+    }
+    *link = proc->hash_next;
+    
+    if (proc->parent) {
+        sibling_remove(proc->state == PROCESS_ZOMBIE ? &proc->parent->zombies :
+                                                       &proc->parent->children, proc);
+    }
+    
+    pid_bitmap[proc->pid / 32] &= ~(1U << (proc->pid % 32));
+}
+
 /* Allocate process structure */
 static process_t* alloc_process(void) {
-    process_t* proc = (process_t*)kmalloc(sizeof(process_t));
+    process_t* proc = (process_t*)kmem_cache_alloc(process_cache);
     if (!proc) return NULL;
     
     memset(proc, 0, sizeof(process_t));
     
-    /* Allocate file descriptor table */
-    proc->fd_table = (struct vfs_node**)kmalloc(sizeof(struct vfs_node*) * MAX_FD_PER_PROCESS);
+    /* Allocate file descriptor table (constructed empty) */
+    proc->fd_table = (struct vfs_node**)kmem_cache_alloc(fd_table_cache);
     if (!proc->fd_table) {
-        kfree(proc);
+        kmem_cache_free(process_cache, proc);
         return NULL;
     }
     
-    memset(proc->fd_table, 0, sizeof(struct vfs_node*) * MAX_FD_PER_PROCESS);
     proc->fd_count = MAX_FD_PER_PROCESS;
     
+    /* Kernel stack for system calls and interrupts taken in user mode */
+    proc->kernel_stack = (uint8_t*)kmalloc_aligned(KERNEL_STACK_SIZE, 16);
+    if (!proc->kernel_stack) {
+        kmem_cache_free(fd_table_cache, proc->fd_table);
+        kmem_cache_free(process_cache, proc);
+        return NULL;
+    }
+    
     return proc;
 }
 
+/* Trap frame at the top of a kernel stack: where every entry from user
+ * mode saves the user registers */
+static registers_t* process_trap_frame(process_t* proc) {
+    return (registers_t*)(proc->kernel_stack + KERNEL_STACK_SIZE) - 1;
+}
+
+/* Point the trap frame at a fresh user image */
+static void process_set_entry(process_t* proc, uint32_t eip, uint32_t esp) {
+    registers_t* frame = process_trap_frame(proc);
+    
+    memset(frame, 0, sizeof(registers_t));
+    frame->gs = GDT_USER_DATA;
+    frame->fs = GDT_USER_DATA;
+    frame->es = GDT_USER_DATA;
+    frame->ds = GDT_USER_DATA;
+    frame->eip = eip;
+    frame->cs = GDT_USER_CODE;
+    frame->eflags = 0x202;                      /* IF */
+    frame->useresp = esp;
+    frame->ss = GDT_USER_DATA;
+}
+
+/* Lay out the kernel stack of a process that has not run yet so that
+ * switching to it returns through interrupt_return into its trap frame */
+static void process_prepare_switch(process_t* proc) {
+    uint32_t* sp = (uint32_t*)process_trap_frame(proc);
+    
+    *--sp = (uint32_t)interrupt_return;         /* switch_context's ret */
+    *--sp = 0;                                  /* ebp */
+    *--sp = 0;                                  /* ebx */
+    *--sp = 0;                                  /* esi */
+    *--sp = 0;                                  /* edi */
+    proc->kernel_esp = (uint32_t)sp;
+}
+
+/* Refresh the virtual size after the region list changed */
+static void process_update_vm(process_t* proc) {
+    proc->vm_pages = region_count_pages(proc->regions);
+}
+
+/* Would growing the address space by pages stay within the cap? */
+static int process_vm_allows(process_t* proc, uint32_t pages) {
+    if (!proc->mem_limit || proc->vm_pages + pages <= proc->mem_limit) return 1;
+    
+    kprintf("[PROC] PID %d hit its memory limit (%u KB)\n", proc->pid, proc->mem_limit * 4);
+    return 0;
+}
+
+/* Adjust the resident page count */
+void process_account_rss(process_t* proc, int delta) {
+    proc = process_mm(proc);
+    if (!proc) return;
+    
+    if (delta < 0 && (uint32_t)-delta > proc->rss_pages) {
+        proc->rss_pages = 0;
+    } else {
+        proc->rss_pages += delta;
+    }
+    if (proc->rss_pages > proc->rss_peak) {
+        proc->rss_peak = proc->rss_pages;
+    }
+}
+
+/* Set or clear the address space cap */
+uint32_t process_set_mem_limit(process_t* proc, uint32_t bytes) {
+    proc = process_mm(proc);
+    if (!proc) return 0;
+    
+    uint32_t old = proc->mem_limit * PAGE_SIZE;
+    proc->mem_limit = bytes / PAGE_SIZE + (bytes % PAGE_SIZE ? 1 : 0);
+    return old;
+}
+
+/* Return a process's address space and regions to the system */
+static void process_release_memory(process_t* proc) {
+    /* A thread only borrows its leader's */
+    if (proc->group_leader) {
+        proc->page_directory = NULL;
+        return;
+    }
+    
+    region_free_all(&proc->regions);
+    proc->vm_pages = 0;
+    proc->rss_pages = 0;
+    
+    if (proc->page_directory) {
+        uint32_t reclaimed = vmm_destroy_address_space(proc->page_directory);
+        proc->page_directory = NULL;
+        kprintf("[PROC] Process %d released %u frames\n", proc->pid, reclaimed);
+    }
+}
+
 /* Free process structure */
 static void free_process(process_t* proc) {
     if (!proc) return;
     
-    /* Free file descriptor table */
+    /* Return file descriptor table in its constructed (empty) state */
     if (proc->fd_table) {
-        kfree(proc->fd_table);
+        memset(proc->fd_table, 0, sizeof(struct vfs_node*) * MAX_FD_PER_PROCESS);
+        kmem_cache_free(fd_table_cache, proc->fd_table);
     }
     
-    /* Free page directory */
-    if (proc->page_directory) {
-        /* TODO: Free all page tables and mapped pages */
-        /* For now, just free the directory itself */
-        kfree(proc->page_directory);
-    }
+    /* Address space is normally gone at exit already */
+    process_release_memory(proc);
     
-    kfree(proc);
+    process_unregister(proc);
+    kfree(proc->kernel_stack);
+    kmem_cache_free(process_cache, proc);
+}
+
+/* The kernel process never waits: free its exited children (orphans,
+ * kernel shell programs, kernel threads) except one that is still on
+ * its own kernel stack */
+static void process_reap_orphans(void) {
+    process_t* reaper = process_get_by_pid(0);
+    if (!reaper) return;
+    
+    process_t* p = reaper->zombies;
+    while (p) {
+        process_t* next = p->sibling_next;
+        if (p != current_process) {
+            free_process(p);
+        }
+        p = next;
+    }
 }
 
 /* Create new process */
@@ -117,8 +357,10 @@ process_t* process_create(const char* name) {
     process_t* proc = alloc_process();
     if (!proc) return NULL;
     
-    proc->pid = next_pid++;
-    proc->parent_pid = current_process ? current_process->pid : 0;
+    if (process_register(proc, current_process) < 0) {
+        free_process(proc);
+        return NULL;
+    }
     proc->state = PROCESS_READY;
     proc->page_directory = vmm_create_page_directory();
     proc->esp = 0;
@@ -129,77 +371,14 @@ process_t* process_create(const char* name) {
     proc->exit_code = 0;
     proc->start_time = timer_get_ticks();
     
-    /* Add to process list */
-    proc->next = process_list;
-    process_list = proc;
-    
     kprintf("[PROC] Created process '%s' (PID %d)\n", name, proc->pid);
     
     return proc;
 }
 
-/* Copy page directory and all pages for fork */
-static uint32_t* clone_page_directory_deep(uint32_t* src_pd) {
-    if (!src_pd) return NULL;
-    
-    uint32_t* new_pd = vmm_create_page_directory();
-    if (!new_pd) return NULL;
-    
-    /* Copy kernel space (identity mapped) */
-    for (int i = 0; i < 256; i++) {  /* First 1GB */
-        new_pd[i] = src_pd[i];
-    }
-    
-    /* Clone user space */
-    for (int i = 256; i < 1024; i++) {
-        uint32_t pd_entry = src_pd[i];
-        
-        if (!(pd_entry & PAGE_PRESENT)) {
-            new_pd[i] = 0;
-            continue;
-        }
-        
-        /* Get source page table */
-        uint32_t* src_pt = (uint32_t*)(pd_entry & ~0xFFF);
-        
-        /* Allocate new page table */
-        uint32_t* new_pt = (uint32_t*)kmalloc_aligned(4096, 4096);
-        if (!new_pt) continue;
-        
-        /* Copy and clone pages */
-        for (int j = 0; j < 1024; j++) {
-            uint32_t pt_entry = src_pt[j];
-            
-            if (!(pt_entry & PAGE_PRESENT)) {
-                new_pt[j] = 0;
-                continue;
-            }
-            
-            /* Allocate new physical page */
-            void* new_page = kmalloc_aligned(4096, 4096);
-            if (!new_page) {
-                new_pt[j] = 0;
-                continue;
-            }
-            
-            /* Copy page contents */
-            void* src_page = (void*)(pt_entry & ~0xFFF);
-            memcpy(new_page, src_page, 4096);
-            
-            /* Set up new page table entry */
-            new_pt[j] = ((uint32_t)new_page & ~0xFFF) | (pt_entry & 0xFFF);
-        }
-        
-        /* Set up new page directory entry */
-        new_pd[i] = ((uint32_t)new_pt & ~0xFFF) | (pd_entry & 0xFFF);
-    }
-    
-    return new_pd;
-}
-
 /* Fork current process */
 process_t* process_fork(process_t* parent) {
-    if (!parent) return NULL;
+    if (!parent || parent->group_leader) return NULL;
     
     kprintf("[PROC] Forking process %d (%s)\n", parent->pid, parent->name);
     
@@ -210,27 +389,46 @@ process_t* process_fork(process_t* parent) {
         return NULL;
     }
     
+    if (process_register(child, parent) < 0) {
+        kprintf("[PROC] Fork failed: process table full\n");
+        free_process(child);
+        return NULL;
+    }
+    
     /* Copy parent process data */
-    child->pid = next_pid++;
-    child->parent_pid = parent->pid;
     child->state = PROCESS_READY;
     strncpy(child->name, parent->name, 64);
     strcpy(child->cwd, parent->cwd);
     child->start_time = timer_get_ticks();
     child->exit_code = 0;
     
-    /* Clone page directory and all user pages */
-    child->page_directory = clone_page_directory_deep(parent->page_directory);
+    /* Clone address space; user pages are shared copy-on-write */
+    child->page_directory = vmm_clone_page_directory(parent->page_directory);
     if (!child->page_directory) {
         kprintf("[PROC] Fork failed: couldn't clone page directory\n");
         free_process(child);
         return NULL;
     }
     
+    if (region_clone(parent->regions, &child->regions) < 0) {
+        kprintf("[PROC] Fork failed: couldn't copy regions\n");
+        free_process(child);
+        return NULL;
+    }
+    
     /* Copy register state (will be set by caller) */
     child->esp = parent->esp;
     child->ebp = parent->ebp;
     child->eip = parent->eip;
+    child->brk_start = parent->brk_start;
+    child->brk = parent->brk;
+    
+    /* Copy-on-write pages count as resident in both */
+    child->rss_pages = parent->rss_pages;
+    child->rss_peak = parent->rss_pages;
+    child->vm_pages = parent->vm_pages;
+    child->mem_limit = parent->mem_limit;
+    child->tls_base = parent->tls_base;
     
     /* Clone file descriptor table */
     if (parent->fd_table) {
@@ -239,101 +437,432 @@ process_t* process_fork(process_t* parent) {
         child->fd_count = parent->fd_count;
     }
     
-    /* Add to process list */
-    child->next = process_list;
-    process_list = child;
+    /* The child resumes from a copy of the parent's trap frame, with 0
+     * as the result of fork */
+    if (parent->kernel_stack) {
+        memcpy(process_trap_frame(child), process_trap_frame(parent), sizeof(registers_t));
+        process_trap_frame(child)->eax = 0;
+        process_prepare_switch(child);
+        scheduler_add(child);
+    }
     
     kprintf("[PROC] Fork successful: parent=%d, child=%d\n", parent->pid, child->pid);
     
     return child;
 }
 
+/* Spawn a program in a new child process */
+process_t* process_spawn(process_t* parent, const char* path, char* const argv[],
+                         char* const envp[]) {
+    if (!parent || !path) return NULL;
+    
+    process_t* child = alloc_process();
+    if (!child) return NULL;
+    
+    if (process_register(child, parent) < 0) {
+        kprintf("[PROC] Spawn failed: process table full\n");
+        free_process(child);
+        return NULL;
+    }
+    
+    strncpy(child->name, path, 64);
+    child->name[63] = '\0';
+    strcpy(child->cwd, parent->cwd);
+    child->start_time = timer_get_ticks();
+    child->mem_limit = parent->mem_limit;
+    
+    /* An empty address space: exec maps the image into it on demand */
+    child->page_directory = vmm_create_page_directory();
+    if (!child->page_directory || process_exec(child, path, argv, envp) < 0) {
+        kprintf("[PROC] Spawn of %s failed\n", path);
+        free_process(child);
+        return NULL;
+    }
+    
+    kprintf("[PROC] Spawned %s: parent=%d, child=%d\n", path, parent->pid, child->pid);
+    return child;
+}
+
+/* End the other threads of a process and free those that exited. The
+ * calling thread, if it is one of them, leaves the group: it is on its
+ * way out too but cannot free its own stack. */
+static void process_end_threads(process_t* leader) {
+    process_t* reaper = process_get_by_pid(0);
+    
+    process_t* p = leader->children;
+    while (p) {
+        process_t* next = p->sibling_next;
+        if (p->group_leader == leader) {
+            if (p == current_process) {
+                sibling_remove(&leader->children, p);
+                sibling_insert(&reaper->children, p);
+                p->parent = reaper;
+                p->parent_pid = reaper->pid;
+                p->group_leader = NULL;
+                p->page_directory = NULL;
+            } else {
+                process_exit(p);
+            }
+        }
+        p = next;
+    }
+    
+    p = leader->zombies;
+    while (p) {
+        process_t* next = p->sibling_next;
+        if (p->group_leader == leader) {
+            free_process(p);
+        }
+        p = next;
+    }
+}
+
+/* Initial user stack of a new image, laid out in kernel memory */
+typedef struct {
+    uint8_t* block;                 /* Contents of [base, USER_STACK_TOP) */
+    uint32_t size;
+    uint32_t base;                  /* User stack pointer at entry */
+    int argc;
+} exec_stack_t;
+
+/* Count a NULL-terminated string vector, adding up its bytes */
+static int exec_count(char* const vec[], uint32_t* bytes) {
+    int n = 0;
+    if (vec) {
+        while (vec[n]) {
+            *bytes += strlen(vec[n]) + 1;
+            n++;
+        }
+    }
+    return n;
+}
+
+/* Copy the strings of a vector and fill in their user addresses */
+static void exec_copy_vector(char* const vec[], int n, uint32_t* ptrs,
+                             uint8_t** str, uint32_t* user_str) {
+    for (int i = 0; i < n; i++) {
+        size_t len = strlen(vec[i]) + 1;
+        memcpy(*str, vec[i], len);
+        ptrs[i] = *user_str;
+        *str += len;
+        *user_str += len;
+    }
+    ptrs[n] = 0;
+}
+
+/* Build the startup data of a new image in one buffer, exactly as it
+ * will sit below USER_STACK_TOP:
+ *
+ *   base:  0 (return address), argc, argv, envp, auxv
+ *          argv[0 .. argc-1], NULL, envp[0 .. envc-1], NULL
+ *          auxv (type, value) pairs up to AT_NULL
+ *          argument and environment strings, padding
+ *
+ * so _start(argc, argv, envp, auxv) finds its parameters like any C
+ * function called with a 16-byte aligned stack, and a single copy puts
+ * everything in place. argv and envp are read here, before the old
+ * image they may live in is dropped. */
+static int exec_build_stack(exec_stack_t* st, char* const argv[], char* const envp[],
+                            uint32_t entry, const elf_info_t* info) {
+    uint32_t strings = 0;
+    int argc = exec_count(argv, &strings);
+    int envc = exec_count(envp, &strings);
+    
+    uint32_t words = 5 + (argc + 1) + (envc + 1) + 2 * EXEC_AUX_COUNT;
+    uint32_t need = words * sizeof(uint32_t) + strings;
+    if (need > EXEC_ARGS_MAX) return -1;
+    
+    st->base = ((USER_STACK_TOP - need) & ~0xF) - sizeof(uint32_t);
+    st->size = USER_STACK_TOP - st->base;
+    st->argc = argc;
+    st->block = (uint8_t*)kmalloc(st->size);
+    if (!st->block) return -1;
+    memset(st->block, 0, st->size);
+    
+    uint32_t argv_addr = st->base + 5 * sizeof(uint32_t);
+    uint32_t envp_addr = argv_addr + (argc + 1) * sizeof(uint32_t);
+    uint32_t auxv_addr = envp_addr + (envc + 1) * sizeof(uint32_t);
+    uint32_t str_addr = auxv_addr + 2 * EXEC_AUX_COUNT * sizeof(uint32_t);
+    
+    uint32_t* w = (uint32_t*)st->block;
+    w[1] = (uint32_t)argc;
+    w[2] = argv_addr;
+    w[3] = envp_addr;
+    w[4] = auxv_addr;
+    
+    uint8_t* str = st->block + (str_addr - st->base);
+    exec_copy_vector(argv, argc, &w[5], &str, &str_addr);
+    exec_copy_vector(envp, envc, &w[5 + argc + 1], &str, &str_addr);
+    
+    uint32_t* aux = &w[5 + argc + 1 + envc + 1];
+    *aux++ = AT_PAGESZ;  *aux++ = PAGE_SIZE;
+    *aux++ = AT_CLKTCK;  *aux++ = TIMER_FREQ;
+    *aux++ = AT_ENTRY;   *aux++ = entry;
+    *aux++ = AT_PHDR;    *aux++ = info->phdr;
+    *aux++ = AT_PHENT;   *aux++ = info->phent;
+    *aux++ = AT_PHNUM;   *aux++ = info->phnum;
+    *aux++ = AT_NULL;    *aux++ = 0;
+    
+    return 0;
+}
+
 /* Load and execute ELF binary */
-int process_exec(process_t* proc, const char* path, char* const argv[]) {
-    if (!proc || !path) return -1;
+int process_exec(process_t* proc, const char* path, char* const argv[], char* const envp[]) {
+    if (!proc || !path || !proc->kernel_stack || proc->group_leader) return -1;
     
     kprintf("[PROC] Executing: %s (PID %d)\n", path, proc->pid);
     
-    /* Load ELF binary */
-    uint32_t entry = elf_load(path);
+    /* Describe the new image; nothing is read until it is touched */
+    vm_region_t* regions = NULL;
+    elf_info_t info;
+    uint32_t entry = elf_load(path, &regions, &info);
     if (entry == 0) {
         kprintf("[PROC] Failed to load: %s\n", path);
+        region_free_all(&regions);
         return -1;
     }
     
-    /* Set up user stack */
-    uint32_t user_stack = USER_STACK_TOP;
+    /* The heap starts on the first page above the image */
+    uint32_t image_end = 0;
+    for (vm_region_t* r = regions; r != NULL; r = r->next) {
+        if (r->end > image_end) image_end = r->end;
+    }
+    image_end = (image_end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
     
-    /* Allocate and map user stack pages */
-    for (uint32_t addr = user_stack - USER_STACK_SIZE; addr < user_stack; addr += PAGE_SIZE) {
-        void* page = kmalloc_aligned(PAGE_SIZE, PAGE_SIZE);
-        if (page) {
-            vmm_map_page(addr, (uint32_t)page, PAGE_PRESENT | PAGE_WRITE | PAGE_USER);
-            memset(page, 0, PAGE_SIZE);
-        }
+    /* Set up user stack (zero-filled on demand) */
+    if (!region_add(&regions, USER_STACK_TOP - USER_STACK_SIZE, USER_STACK_TOP,
+                    REGION_READ | REGION_WRITE, NULL, 0, 0)) {
+        kprintf("[PROC] Failed to set up stack for: %s\n", path);
+        region_free_all(&regions);
+        return -1;
     }
     
-    /* Push arguments onto stack */
-    int argc = 0;
-    if (argv) {
-        /* Count arguments */
-        while (argv[argc]) argc++;
-        
-        /* Allocate space for argument pointers */
-        uint32_t* arg_ptrs = (uint32_t*)kmalloc(sizeof(uint32_t) * (argc + 1));
-        
-        /* Push argument strings onto stack */
-        for (int i = argc - 1; i >= 0; i--) {
-            size_t len = strlen(argv[i]) + 1;
-            user_stack -= len;
-            
-            /* Copy string to user stack */
-            /* In real implementation, would copy to user space properly */
-            arg_ptrs[i] = user_stack;
-        }
-        
-        /* Align stack to 16 bytes */
-        user_stack &= ~0xF;
-        
-        /* Push NULL terminator for argv */
-        user_stack -= sizeof(uint32_t);
-        
-        /* Push argv pointers */
-        for (int i = argc - 1; i >= 0; i--) {
-            user_stack -= sizeof(uint32_t);
-            /* Write arg_ptrs[i] to stack */
+    if (proc->mem_limit && region_count_pages(regions) > proc->mem_limit) {
+        kprintf("[PROC] %s exceeds the memory limit of PID %d\n", path, proc->pid);
+        region_free_all(&regions);
+        return -1;
+    }
+    
+    exec_stack_t stack;
+    if (exec_build_stack(&stack, argv, envp, entry, &info) < 0) {
+        kprintf("[PROC] Arguments too long for: %s\n", path);
+        region_free_all(&regions);
+        return -1;
+    }
+    
+    /* Drop the old image and the threads running in it */
+    process_end_threads(proc);
+    vmm_clear_user_space(proc->page_directory);
+    region_free_all(&proc->regions);
+    proc->regions = regions;
+    proc->brk_start = image_end;
+    proc->brk = image_end;
+    proc->rss_pages = 0;
+    proc->tls_base = 0;
+    process_update_vm(proc);
+    
+    /* Put the startup data on the new stack */
+    int mapped = vmm_copy_to_space(proc->page_directory, stack.base, stack.block,
+                                   stack.size, PAGE_USER | PAGE_WRITE | PAGE_NOEXEC);
+    kfree(stack.block);
+    if (mapped < 0) {
+        kprintf("[PROC] Out of memory building the stack of: %s\n", path);
+        if (proc == current_process) {
+            proc->exit_code = -1;
+            process_exit(proc);
         }
-        
-        /* Push argv pointer */
-        uint32_t argv_ptr = user_stack;
-        user_stack -= sizeof(uint32_t);
-        
-        /* Push argc */
-        user_stack -= sizeof(uint32_t);
-        
-        kfree(arg_ptrs);
+        return -1;
     }
+    process_account_rss(proc, mapped);
+    
+    uint32_t user_stack = stack.base;
     
     /* Set process entry point and stack */
     proc->eip = entry;
     proc->esp = user_stack;
     proc->ebp = user_stack;
-    proc->state = PROCESS_READY;
+    
+    /* The image starts on the next return to user mode: right away when
+     * a process execs itself, else when the scheduler first picks it */
+    process_set_entry(proc, entry, user_stack);
+    if (proc != current_process) {
+        process_prepare_switch(proc);
+        proc->state = PROCESS_READY;
+        scheduler_add(proc);
+    }
     
     kprintf("[PROC] Process ready: entry=0x%x, stack=0x%x, argc=%d\n", 
-            entry, user_stack, argc);
+            entry, user_stack, stack.argc);
+    
+    return 0;
+}
+
+/* Move the program break */
+uint32_t process_brk(process_t* proc, uint32_t addr) {
+    proc = process_mm(proc);
+    if (!proc || !proc->brk_start) return 0;
+    if (addr == 0 || addr == proc->brk) return proc->brk;
+    if (addr < proc->brk_start || addr >= USER_SPACE_END) return proc->brk;
+    
+    /* The heap region covers whole pages up to the break */
+    uint32_t old_end = (proc->brk + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    uint32_t new_end = (addr + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    vm_region_t* heap = region_find(proc->regions, proc->brk_start);
+    
+    if (new_end > old_end) {
+        if (!process_vm_allows(proc, (new_end - old_end) / PAGE_SIZE)) return proc->brk;
+        if (heap) {
+            if (region_resize(proc->regions, heap, new_end) < 0) return proc->brk;
+        } else if (!region_add(&proc->regions, proc->brk_start, new_end,
+                               REGION_READ | REGION_WRITE, NULL, 0, 0)) {
+            return proc->brk;
+        }
+    } else if (new_end < old_end && heap) {
+        process_account_rss(proc, -(int)vmm_unmap_range(new_end, old_end - new_end));
+        if (new_end == proc->brk_start) {
+            region_remove(&proc->regions, heap);
+        } else {
+            region_resize(proc->regions, heap, new_end);
+        }
+    }
+    
+    proc->brk = addr;
+    process_update_vm(proc);
+    return proc->brk;
+}
+
+/* Map anonymous memory or a file */
+uint32_t process_mmap(process_t* proc, uint32_t addr, uint32_t length, uint32_t flags,
+                      int fixed, struct vfs_node* file, uint32_t offset) {
+    proc = process_mm(proc);
+    if (!proc || length == 0 || (offset & (PAGE_SIZE - 1))) return 0;
+    if (length > USER_SPACE_END - USER_SPACE_START) return 0;
+    length = (length + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    
+    if (fixed) {
+        if ((addr & (PAGE_SIZE - 1)) || addr < USER_SPACE_START ||
+            addr > USER_SPACE_END - length) {
+            return 0;
+        }
+        if (process_munmap(proc, addr, length) < 0) return 0;
+    } else {
+        /* Take the hint if it is free, else search down from the stack */
+        uint32_t heap_end = (proc->brk + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        uint32_t low = heap_end > USER_SPACE_START ? heap_end : USER_SPACE_START;
+        uint32_t high = USER_STACK_TOP - USER_STACK_SIZE;
+        
+        addr &= ~(PAGE_SIZE - 1);
+        if (!addr || addr < low || addr > high - length ||
+            region_find_gap(proc->regions, length, addr, addr + length) != addr) {
+            addr = region_find_gap(proc->regions, length, low, high);
+        }
+        if (!addr) return 0;
+    }
+    
+    uint32_t file_size = 0;
+    if (file && offset < file->length) {
+        file_size = file->length - offset;
+        if (file_size > length) file_size = length;
+    }
+    
+    if (!process_vm_allows(proc, length / PAGE_SIZE)) return 0;
+    if (!region_add(&proc->regions, addr, addr + length, flags, file, offset, file_size)) {
+        return 0;
+    }
+    
+    process_update_vm(proc);
+    return addr;
+}
+
+/* Unmap part of the address space */
+int process_munmap(process_t* proc, uint32_t addr, uint32_t length) {
+    proc = process_mm(proc);
+    if (!proc || length == 0 || (addr & (PAGE_SIZE - 1))) return -1;
+    if (addr < USER_SPACE_START || addr >= USER_SPACE_END) return -1;
+    if (length > USER_SPACE_END - addr) return -1;
+    length = (length + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    
+    if (region_unmap(&proc->regions, addr, addr + length) < 0) return -1;
+    process_account_rss(proc, -(int)vmm_unmap_range(addr, length));
+    process_update_vm(proc);
+    
+    return 0;
+}
+
+/* Change protection of part of the address space */
+int process_mprotect(process_t* proc, uint32_t addr, uint32_t length, uint32_t flags) {
+    proc = process_mm(proc);
+    if (!proc || length == 0 || (addr & (PAGE_SIZE - 1))) return -1;
+    if (addr < USER_SPACE_START || addr >= USER_SPACE_END) return -1;
+    if (length > USER_SPACE_END - addr) return -1;
+    length = (length + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    
+    if (region_protect(proc->regions, addr, addr + length, flags) < 0) return -1;
+    
+    /* Pages with no access at all stay mapped but supervisor-only */
+    uint32_t pte_flags = 0;
+    if (flags & (REGION_READ | REGION_WRITE | REGION_EXEC)) pte_flags |= PAGE_USER;
+    if (flags & REGION_WRITE) pte_flags |= PAGE_WRITE;
+    if (!(flags & REGION_EXEC)) pte_flags |= PAGE_NOEXEC;
+    vmm_protect_range(addr, length, pte_flags);
     
     return 0;
 }
 
+/* Attach shared memory segment */
+uint32_t process_shm_attach(process_t* proc, int id) {
+    proc = process_mm(proc);
+    if (!proc) return 0;
+    
+    shm_segment_t* seg = shm_get(id);
+    if (!seg) return 0;
+    
+    uint32_t heap_end = (proc->brk + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    uint32_t low = heap_end > USER_SPACE_START ? heap_end : USER_SPACE_START;
+    uint32_t addr = region_find_gap(proc->regions, seg->size, low,
+                                    USER_STACK_TOP - USER_STACK_SIZE);
+    
+    vm_region_t* region = NULL;
+    if (addr && process_vm_allows(proc, seg->size / PAGE_SIZE)) {
+        region = region_add(&proc->regions, addr, addr + seg->size,
+                            REGION_READ | REGION_WRITE, NULL, 0, 0);
+    }
+    if (!region) {
+        shm_release(seg);
+        return 0;
+    }
+    
+    /* The region keeps the reference taken by shm_get */
+    region->shm = seg;
+    process_update_vm(proc);
+    return addr;
+}
+
+/* Detach shared memory segment */
+int process_shm_detach(process_t* proc, uint32_t addr) {
+    proc = process_mm(proc);
+    if (!proc) return -1;
+    
+    vm_region_t* region = region_find(proc->regions, addr);
+    if (!region || !region->shm || region->start != addr) return -1;
+    
+    uint32_t length = region->end - region->start;
+    return process_munmap(proc, addr, length);
+}
+
 /* Exit process */
 void process_exit(process_t* proc) {
-    if (!proc) return;
+    if (!proc || proc->state == PROCESS_ZOMBIE) return;
     
     kprintf("[PROC] Process %d (%s) exiting with code %d\n", 
             proc->pid, proc->name, proc->exit_code);
     
+    process_reap_orphans();
+    
     proc->state = PROCESS_ZOMBIE;
+    scheduler_remove(proc);
+    timer_cancel(&proc->sleep_timer);
+    wait_remove(proc);
     
     /* Close all file descriptors */
     for (int i = 0; i < (int)proc->fd_count; i++) {
@@ -342,84 +871,234 @@ void process_exit(process_t* proc) {
         }
     }
     
-    /* Wake up parent if waiting */
-    if (proc->parent_pid > 0) {
-        process_t* parent = process_get_by_pid(proc->parent_pid);
-        if (parent && parent->state == PROCESS_BLOCKED) {
-            parent->state = PROCESS_READY;
-            kprintf("[PROC] Waking up parent process %d\n", parent->pid);
-        }
+    /* A process takes its threads with it */
+    if (!proc->group_leader) {
+        process_end_threads(proc);
+    }
+    
+    /* A zombie only keeps its exit code: free its memory now rather than
+     * when (if ever) the parent reaps it. The kernel's own directory stays. */
+    if (proc->pid != 0) {
+        process_release_memory(proc);
+    }
+    
+    /* Move to the parent's zombies and wake it up if waiting */
+    process_t* parent = proc->parent;
+    if (parent) {
+        sibling_remove(&parent->children, proc);
+        sibling_insert(&parent->zombies, proc);
+        wake_up(&parent->child_exit);
     }
     
-    /* Reparent children to init (PID 1) or kernel (PID 0) */
-    for (process_t* p = process_list; p != NULL; p = p->next) {
-        if (p->parent_pid == proc->pid) {
-            p->parent_pid = 1;  /* Reparent to init */
-            kprintf("[PROC] Reparented process %d to init\n", p->pid);
+    /* Reparent children, live and exited, to the kernel process */
+    process_t* reaper = process_get_by_pid(0);
+    if (reaper && reaper != proc) {
+        while (proc->children) {
+            process_t* p = proc->children;
+            sibling_remove(&proc->children, p);
+            sibling_insert(&reaper->children, p);
+            p->parent = reaper;
+            p->parent_pid = reaper->pid;
+            kprintf("[PROC] Reparented process %d to %d\n", p->pid, reaper->pid);
         }
+        while (proc->zombies) {
+            process_t* p = proc->zombies;
+            sibling_remove(&proc->zombies, p);
+            sibling_insert(&reaper->zombies, p);
+            p->parent = reaper;
+            p->parent_pid = reaper->pid;
+        }
+        wake_up(&reaper->child_exit);
     }
     
-    /* If this is current process, schedule next */
+    /* If this is current process, schedule next; nothing ever switches
+     * back to a zombie, its kernel stack is freed when it is reaped */
     if (current_process == proc) {
-        current_process = NULL;
-        /* Scheduler will pick next process */
+        scheduler_schedule();
     }
 }
 
-/* Wait for child process */
-int process_wait(process_t* proc, int* status) {
-    if (!proc) return -1;
+/* First exited child that is a process, not a thread (those are
+ * reaped by process_thread_join) */
+static process_t* process_find_zombie(process_t* proc) {
+    for (process_t* p = proc->zombies; p != NULL; p = p->sibling_next) {
+        if (!p->group_leader) return p;
+    }
+    return NULL;
+}
+
+/* Exit a whole process from any of its threads */
+void process_exit_group(process_t* proc, int code) {
+    if (!proc) return;
     
-    kprintf("[PROC] Process %d waiting for child\n", proc->pid);
+    process_t* leader = process_mm(proc);
+    if (leader != proc) {
+        leader->exit_code = code;
+        process_exit(leader);
+    }
+    proc->exit_code = code;
+    process_exit(proc);
+}
+
+/* Start a user thread */
+process_t* process_thread_create(process_t* proc, uint32_t entry, uint32_t stack, uint32_t tls) {
+    process_t* leader = process_mm(proc);
+    if (!leader || !leader->page_directory || !leader->kernel_stack) return NULL;
     
-    /* Find zombie children */
-    process_t* child = NULL;
-    process_t** prev_ptr = &process_list;
+    process_t* thread = alloc_process();
+    if (!thread) return NULL;
     
-    for (process_t* p = process_list; p != NULL; p = p->next) {
-        if (p->parent_pid == proc->pid && p->state == PROCESS_ZOMBIE) {
-            child = p;
-            *prev_ptr = p->next;  /* Remove from list */
-            break;
-        }
-        prev_ptr = &p->next;
+    /* Set before anything can fail so free_process leaves the space alone */
+    thread->group_leader = leader;
+    thread->page_directory = leader->page_directory;
+    
+    if (process_register(thread, leader) < 0) {
+        kprintf("[PROC] Thread creation failed: process table full\n");
+        free_process(thread);
+        return NULL;
     }
     
-    if (child) {
-        /* Found zombie child */
-        if (status) {
-            *status = child->exit_code;
-        }
-        
-        int pid = child->pid;
-        kprintf("[PROC] Reaped child process %d\n", pid);
-        
-        /* Clean up zombie */
-        free_process(child);
-        
-        return pid;
+    strncpy(thread->name, leader->name, 64);
+    strcpy(thread->cwd, proc->cwd);
+    thread->start_time = timer_get_ticks();
+    thread->eip = entry;
+    thread->esp = stack;
+    thread->ebp = stack;
+    
+    process_set_entry(thread, entry, stack);
+    process_set_tls(thread, tls);
+    process_prepare_switch(thread);
+    thread->state = PROCESS_READY;
+    scheduler_add(thread);
+    
+    kprintf("[PROC] Thread %d started in process %d\n", thread->pid, leader->pid);
+    return thread;
+}
+
+/* Whether thread tid of leader has exited (or is no such thread) */
+static int process_thread_done(process_t* leader, uint32_t tid) {
+    process_t* thread = process_get_by_pid(tid);
+    return !thread || thread->group_leader != leader || thread->state == PROCESS_ZOMBIE;
+}
+
+/* Wait for a thread to exit and reap it */
+int process_thread_join(process_t* proc, uint32_t tid, int* status) {
+    process_t* leader = process_mm(proc);
+    process_t* thread = process_get_by_pid(tid);
+    if (!leader || !thread || thread == proc || thread->group_leader != leader) return -1;
+    
+    /* Exiting threads wake their leader's child_exit */
+    if (wait_event_interruptible(leader->child_exit, process_thread_done(leader, tid)) < 0) {
+        return -1;
     }
     
-    /* Check if we have any children at all */
-    int has_children = 0;
-    for (process_t* p = process_list; p != NULL; p = p->next) {
-        if (p->parent_pid == proc->pid) {
-            has_children = 1;
-            break;
-        }
+    /* Another joiner may have been first */
+    thread = process_get_by_pid(tid);
+    if (!thread || thread->group_leader != leader) return -1;
+    
+    if (status) {
+        *status = thread->exit_code;
+    }
+    free_process(thread);
+    
+    return (int)tid;
+}
+
+/* Set the TLS segment base; the trap frame selector reloads it on the
+ * way back to user mode */
+void process_set_tls(process_t* proc, uint32_t base) {
+    if (!proc || !proc->kernel_stack) return;
+    
+    proc->tls_base = base;
+    process_trap_frame(proc)->gs = base ? GDT_USER_TLS : GDT_USER_DATA;
+    if (proc == current_process) {
+        gdt_set_tls_base(base);
+    }
+}
+
+/* Start a kernel thread */
+process_t* kthread_create(const char* name, int (*fn)(void*), void* arg) {
+    if (!fn) return NULL;
+    
+    process_t* thread = alloc_process();
+    if (!thread) return NULL;
+    
+    if (process_register(thread, process_get_by_pid(0)) < 0) {
+        kprintf("[PROC] Kernel thread creation failed: process table full\n");
+        free_process(thread);
+        return NULL;
+    }
+    
+    strncpy(thread->name, name, 64);
+    thread->name[63] = '\0';
+    strcpy(thread->cwd, "/");
+    thread->start_time = timer_get_ticks();
+    
+    /* No page directory of its own: it runs in whichever address space
+     * is active, all of them map the kernel. switch_context returns
+     * into kthread_start with fn in ebx and arg in esi. */
+    uint32_t* sp = (uint32_t*)(thread->kernel_stack + KERNEL_STACK_SIZE);
+    sp -= 3;                                    /* Call into fn 16-byte aligned */
+    *--sp = (uint32_t)kthread_start;            /* switch_context's ret */
+    *--sp = 0;                                  /* ebp */
+    *--sp = (uint32_t)fn;                       /* ebx */
+    *--sp = (uint32_t)arg;                      /* esi */
+    *--sp = 0;                                  /* edi */
+    thread->kernel_esp = (uint32_t)sp;
+    
+    thread->state = PROCESS_READY;
+    scheduler_add(thread);
+    
+    kprintf("[PROC] Kernel thread '%s' started (PID %d)\n", thread->name, thread->pid);
+    return thread;
+}
+
+/* End the calling kernel thread */
+void kthread_exit(int code) {
+    current_process->exit_code = code;
+    process_exit(current_process);
+}
+
+/* Whether a process has a child it could reap, or none at all (so
+ * waiting would be pointless) */
+static int process_wait_ready(process_t* proc) {
+    if (process_find_zombie(proc)) return 1;
+    
+    for (process_t* p = proc->children; p != NULL; p = p->sibling_next) {
+        if (!p->group_leader) return 0;
+    }
+    return 1;
+}
+
+/* Wait for child process */
+int process_wait(process_t* proc, int* status) {
+    if (!proc) return -1;
+    
+    kprintf("[PROC] Process %d waiting for child\n", proc->pid);
+    
+    /* Sleep until a child exits; process_exit wakes child_exit */
+    if (wait_event_interruptible(proc->child_exit, process_wait_ready(proc)) < 0) {
+        return -1;
     }
     
-    if (!has_children) {
+    process_t* child = process_find_zombie(proc);
+    if (!child) {
         kprintf("[PROC] No children to wait for\n");
         return -1;  /* No children */
     }
     
-    /* Block until child exits */
-    kprintf("[PROC] Blocking process %d\n", proc->pid);
-    proc->state = PROCESS_BLOCKED;
+    /* Found zombie child */
+    if (status) {
+        *status = child->exit_code;
+    }
     
-    /* Will be woken up when child exits */
-    return 0;
+    int pid = child->pid;
+    kprintf("[PROC] Reaped child process %d\n", pid);
+    
+    /* Clean up zombie (this unlinks it and frees its PID) */
+    free_process(child);
+    
+    return pid;
 }
 
 /* Get current process */
@@ -429,41 +1108,42 @@ process_t* process_get_current(void) {
 
 /* Switch to next process */
 void process_switch(process_t* next) {
-    if (!next) return;
-    
     process_t* prev = current_process;
+    if (!next || !prev || next == prev) return;
+    
+    uint32_t flags;
+    __asm__ volatile("pushf; pop %0; cli" : "=r"(flags));
     
     /* Save previous process state if running */
-    if (prev && prev != next) {
-        if (prev->state == PROCESS_RUNNING) {
-            prev->state = PROCESS_READY;
-        }
-        
-        kprintf("[PROC] Switching: %d (%s) -> %d (%s)\n",
-                prev->pid, prev->name, next->pid, next->name);
+    if (prev->state == PROCESS_RUNNING) {
+        prev->state = PROCESS_READY;
     }
     
     /* Set new current process */
     current_process = next;
     next->state = PROCESS_RUNNING;
     
+    /* Entries from user mode land on the new process's kernel stack */
+    if (next->kernel_stack) {
+        tss_set_kernel_stack((uint32_t)next->kernel_stack + KERNEL_STACK_SIZE);
+    }
+    gdt_set_tls_base(next->tls_base);
+    
     /* Switch page directory if different */
     if (next->page_directory && 
         next->page_directory != vmm_get_page_directory()) {
         vmm_switch_page_directory(next->page_directory);
     }
     
-    /* Context switch */
-    if (prev && prev != next) {
-        /* Save/restore registers */
-        /* In real implementation: */
-        /* switch_context(&prev->esp, next->esp); */
-    }
+    /* Returns when some later switch comes back to prev */
+    switch_context(&prev->kernel_esp, next->kernel_esp);
+    
+    __asm__ volatile("push %0; popf" :: "r"(flags) : "memory", "cc");
 }
 
 /* Get process by PID */
 process_t* process_get_by_pid(uint32_t pid) {
-    for (process_t* proc = process_list; proc != NULL; proc = proc->next) {
+    for (process_t* proc = pid_hash[pid % PID_HASH_SIZE]; proc != NULL; proc = proc->hash_next) {
         if (proc->pid == pid) {
             return proc;
         }
@@ -471,13 +1151,19 @@ process_t* process_get_by_pid(uint32_t pid) {
     return NULL;
 }
 
+/* Process table entry */
+process_t* process_get_at(uint32_t index) {
+    return index < process_total ? process_table[index] : NULL;
+}
+
 /* List all processes (for debugging) */
 void process_list_all(void) {
     kprintf("[PROC] Process List:\n");
     kprintf("  PID  PPID  STATE     NAME\n");
     kprintf("  ---  ----  --------  ----\n");
     
-    for (process_t* p = process_list; p != NULL; p = p->next) {
+    for (uint32_t i = 0; i < process_total; i++) {
+        process_t* p = process_table[i];
         const char* state_str;
         switch (p->state) {
             case PROCESS_READY:   state_str = "READY   "; break;
@@ -499,8 +1185,23 @@ int process_kill(uint32_t pid, int signal) {
     
     kprintf("[PROC] Killing process %d with signal %d\n", pid, signal);
     
-    /* For now, just exit the process */
     proc->exit_code = signal;
+    
+    /* A thread killing its own process goes down with it, rather than
+     * being left running in a destroyed address space */
+    if (proc != current_process && !proc->group_leader &&
+        process_mm(current_process) == proc) {
+        process_exit_group(current_process, signal);
+        return 0;
+    }
+    
+    /* A process asleep in a system call is woken to unwind it and exits
+     * on the way back to user mode */
+    if (proc != current_process && wait_interrupt(proc)) {
+        proc->kill_pending = 1;
+        return 0;
+    }
+    
     process_exit(proc);
     
     return 0;
@@ -508,9 +1209,38 @@ int process_kill(uint32_t pid, int signal) {
 
 /* Get process count */
 int process_count(void) {
-    int count = 0;
-    for (process_t* p = process_list; p != NULL; p = p->next) {
-        count++;
-    }
-    return count;
-}
\ No newline at end of file
+    return (int)process_total;
+}
+
+/* First code a kernel thread runs: interrupts were off across the
+ * switch, then fn(arg) and kthread_exit with its result */
+__asm__(
+    ".global kthread_start\n"
+    "kthread_start:\n"
+    "   sti\n"
+    "   push %esi\n"
+    "   call *%ebx\n"
+    "   push %eax\n"
+    "   call kthread_exit\n"
+);
+
+/* Context switch: callee-saved registers go on the old stack, the rest
+ * of the caller's state is already there (C calling convention or, for
+ * user mode, the trap frame) */
+__asm__(
+    ".global switch_context\n"
+    "switch_context:\n"
+    "   mov 4(%esp), %eax\n"
+    "   mov 8(%esp), %edx\n"
+    "   push %ebp\n"
+    "   push %ebx\n"
+    "   push %esi\n"
+    "   push %edi\n"
+    "   mov %esp, (%eax)\n"
+    "   mov %edx, %esp\n"
+    "   pop %edi\n"
+    "   pop %esi\n"
+    "   pop %ebx\n"
+    "   pop %ebp\n"
+    "   ret\n"
+);
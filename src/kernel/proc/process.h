@@ -5,6 +5,8 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "../core/timer.h"
+#include "wait.h"
 
 /* Process states */
 typedef enum {
@@ -22,9 +24,28 @@ typedef struct process {
     process_state_t state;           /* Process state */
     
     uint32_t* page_directory;        /* Page directory */
-    uint32_t esp;                    /* Stack pointer */
+    struct vm_region* regions;       /* Demand-paged user mappings */
+    uint32_t brk_start;              /* Start of the user heap */
+    uint32_t brk;                    /* Current program break */
+    uint32_t rss_pages;              /* Resident user pages */
+    uint32_t rss_peak;               /* Highest rss_pages seen */
+    uint32_t vm_pages;               /* Pages spanned by regions */
+    uint32_t mem_limit;              /* Cap on vm_pages, 0 for none */
+    uint32_t esp;                    /* User stack pointer at entry */
     uint32_t ebp;                    /* Base pointer */
-    uint32_t eip;                    /* Instruction pointer */
+    uint32_t eip;                    /* User entry point */
+    uint8_t* kernel_stack;           /* KERNEL_STACK_SIZE bytes, NULL for PID 0 */
+    uint32_t kernel_esp;             /* Saved by switch_context while not running */
+    uint8_t sched_level;             /* Scheduler priority level, 0 = highest */
+    uint8_t sched_queued;            /* On a scheduler run list */
+    struct process* run_next;        /* Run list links */
+    struct process* run_prev;
+    ktimer_t sleep_timer;            /* Wakes the process from timer_sleep */
+    wait_queue_t* wait_queue;        /* Queue the process sleeps on, if any */
+    struct process* wait_next;       /* Next sleeper on that queue */
+    uint8_t wait_interruptible;      /* Sleep may be ended by a kill */
+    uint8_t kill_pending;            /* Killed while asleep, exits on syscall return */
+    wait_queue_t child_exit;         /* Woken when a child exits */
     
     char name[64];                   /* Process name */
     char cwd[256];                   /* Current working directory */
@@ -36,9 +57,28 @@ typedef struct process {
     struct vfs_node** fd_table;      /* File descriptor table */
     uint32_t fd_count;               /* Number of open files */
     
-    struct process* next;            /* Next process in list */
+    /* Family: a child sits on its parent's children list while alive and
+     * on its zombies list once it has exited */
+    struct process* parent;          /* NULL for the kernel process */
+    struct process* children;        /* Live children */
+    struct process* zombies;         /* Exited children not yet reaped */
+    struct process* sibling_next;    /* Links within one of those lists */
+    struct process* sibling_prev;
+    
+    struct process* hash_next;       /* PID hash chain */
+    uint32_t table_index;            /* Slot in the process table */
+    
+    /* Threads: a user thread is a child of its group leader and shares
+     * the leader's address space; a kernel thread has no user space */
+    struct process* group_leader;    /* NULL unless a user thread */
+    uint32_t tls_base;               /* Base of the GDT_USER_TLS segment */
 } process_t;
 
+/* Process owning the address space of proc (its leader for a thread) */
+static inline process_t* process_mm(process_t* proc) {
+    return (proc && proc->group_leader) ? proc->group_leader : proc;
+}
+
 /* Initialize process management */
 void process_init(void);
 
@@ -48,13 +88,74 @@ process_t* process_create(const char* name);
 /* Fork current process */
 process_t* process_fork(process_t* parent);
 
-/* Execute program */
-int process_exec(process_t* proc, const char* path, char* const argv[]);
+/* Execute program. argv and envp (either may be NULL) are copied onto
+ * the new stack with an auxiliary vector for _start(argc, argv, envp, auxv). */
+int process_exec(process_t* proc, const char* path, char* const argv[], char* const envp[]);
+
+/* Start a program in a new child of parent, built straight from the ELF
+ * file rather than from a copy of the parent. The child inherits the
+ * working directory and memory cap; descriptors are system-wide VFS
+ * slots that it shares with everyone already. */
+process_t* process_spawn(process_t* parent, const char* path, char* const argv[],
+                         char* const envp[]);
+
+/* Move the program break to addr (0 queries it); the heap pages are
+ * demand-zeroed. Returns the resulting break, unchanged on failure. */
+uint32_t process_brk(process_t* proc, uint32_t addr);
+
+/* Map length bytes of anonymous memory or of a file (read through its
+ * vfs node from offset, page-aligned) with REGION_* flags. addr is a hint
+ * unless fixed is set. Returns the address, 0 on failure. */
+uint32_t process_mmap(process_t* proc, uint32_t addr, uint32_t length, uint32_t flags,
+                      int fixed, struct vfs_node* file, uint32_t offset);
+
+/* Unmap [addr, addr + length) of the current process (0 on success) */
+int process_munmap(process_t* proc, uint32_t addr, uint32_t length);
+
+/* Change the REGION_* flags of [addr, addr + length) (0 on success) */
+int process_mprotect(process_t* proc, uint32_t addr, uint32_t length, uint32_t flags);
+
+/* Map shared memory segment id into the process (returns the address,
+ * 0 on failure) and unmap an attachment by its address */
+uint32_t process_shm_attach(process_t* proc, int id);
+int process_shm_detach(process_t* proc, uint32_t addr);
+
+/* Adjust the resident page count after pages were mapped or dropped */
+void process_account_rss(process_t* proc, int delta);
+
+/* Cap the address space at bytes (rounded up to pages, 0 removes the
+ * cap). Inherited by fork and kept across exec; mappings that would
+ * exceed it fail. Returns the previous cap in bytes. */
+uint32_t process_set_mem_limit(process_t* proc, uint32_t bytes);
 
 /* Exit process */
 void process_exit(process_t* proc);
 
-/* Wait for child process */
+/* Exit the whole process proc belongs to, all its threads included */
+void process_exit_group(process_t* proc, int code);
+
+/* Start a user thread in the process of proc at entry, on the user stack
+ * stack, with its TLS segment based at tls. Only the leader may fork or
+ * exec; both exit and exec end the other threads. */
+process_t* process_thread_create(process_t* proc, uint32_t entry, uint32_t stack, uint32_t tls);
+
+/* Wait for thread tid of proc's process to exit and reap it. Returns tid,
+ * -1 if it is not a thread of the process or the wait was interrupted. */
+int process_thread_join(process_t* proc, uint32_t tid, int* status);
+
+/* Set the base of a thread's TLS segment */
+void process_set_tls(process_t* proc, uint32_t base);
+
+/* Start a kernel thread running fn(arg) in ring 0. It sees only kernel
+ * memory, is never preempted (it must block or yield) and exits when fn
+ * returns; the kernel process reaps it like its other children. */
+process_t* kthread_create(const char* name, int (*fn)(void*), void* arg);
+
+/* End the calling kernel thread */
+void kthread_exit(int code);
+
+/* Wait for a child to exit and reap it; sleeps while the children are
+ * all alive. Returns its PID, -1 without children or when killed. */
 int process_wait(process_t* proc, int* status);
 
 /* Get current process */
@@ -66,4 +167,11 @@ void process_switch(process_t* next);
 /* Get process by PID */
 process_t* process_get_by_pid(uint32_t pid);
 
+/* Number of processes, zombies included */
+int process_count(void);
+
+/* Process at a process table index below process_count(). Exits and
+ * reaps move processes between slots. */
+process_t* process_get_at(uint32_t index);
+
 #endif /* PROCESS_H */
\ No newline at end of file
@@ -1,63 +1,330 @@
-/* scheduler.c - Simple round-robin scheduler */
+/* scheduler.c - Multilevel feedback queue scheduler
+ *
+ * READY processes wait on one of SCHED_LEVELS run lists, linked through
+ * the processes themselves; a bitmap of non-empty levels makes picking
+ * the highest-priority process O(1). The running process is on no list.
+ *
+ * A process starts at level 0. Using up its whole time slice moves it
+ * one level down, where slices are twice as long; blocking before the
+ * slice runs out keeps its level, and keyboard input lifts the reader
+ * back to level 0. Every SCHED_BOOST_PERIOD ticks all processes return
+ * to level 0 so CPU hogs cannot be starved for good.
+ *
+ * The timer only preempts a process whose tick interrupted user mode:
+ * the kernel itself is never preempted and gives the CPU away when it
+ * blocks or yields. When nothing at all is ready the blocked process
+ * idles in place, zeroing frames and halting until an interrupt wakes
+ * someone.
+ */
 
 #include "scheduler.h"
+#include "../mm/zpool.h"
 #include "../core/console.h"
 
-#define MAX_PROCESSES 64
+typedef struct {
+    process_t* head;
+    process_t* tail;
+} run_list_t;
 
-static process_t* ready_queue[MAX_PROCESSES];
-static int queue_size = 0;
-static int current_index = 0;
+static run_list_t run_lists[SCHED_LEVELS];
+static uint32_t ready_bitmap = 0;           /* Bit n: level n non-empty */
+static uint32_t depth[SCHED_LEVELS];
+static uint32_t dispatches[SCHED_LEVELS];
+static uint32_t demotions = 0;
+static uint32_t wakeup_boosts = 0;
+static uint32_t periodic_boosts = 0;
+
+static int slice_left = SCHED_QUANTUM;
+static int need_resched = 0;                /* A higher level became ready */
+static uint32_t boost_countdown = SCHED_BOOST_PERIOD;
+
+/* Disable interrupts, returning the previous flags */
+static inline uint32_t sched_lock(void) {
+    uint32_t flags;
+    __asm__ volatile("pushf; pop %0; cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+/* Restore the flags saved by sched_lock */
+static inline void sched_unlock(uint32_t flags) {
+    __asm__ volatile("push %0; popf" :: "r"(flags) : "memory", "cc");
+}
+
+/* Time slice of a level in ticks */
+static int level_quantum(uint32_t level) {
+    return SCHED_QUANTUM << level;
+}
+
+/* Append a process to the run list of its level */
+static void enqueue(process_t* proc) {
+    run_list_t* list = &run_lists[proc->sched_level];
+    
+    proc->run_next = NULL;
+    proc->run_prev = list->tail;
+    if (list->tail) {
+        list->tail->run_next = proc;
+    } else {
+        list->head = proc;
+    }
+    list->tail = proc;
+    
+    proc->sched_queued = 1;
+    depth[proc->sched_level]++;
+    ready_bitmap |= 1U << proc->sched_level;
+}
+
+/* Unlink a process from its run list */
+static void dequeue(process_t* proc) {
+    run_list_t* list = &run_lists[proc->sched_level];
+    
+    if (proc->run_prev) {
+        proc->run_prev->run_next = proc->run_next;
+    } else {
+        list->head = proc->run_next;
+    }
+    if (proc->run_next) {
+        proc->run_next->run_prev = proc->run_prev;
+    } else {
+        list->tail = proc->run_prev;
+    }
+    proc->run_next = NULL;
+    proc->run_prev = NULL;
+    
+    proc->sched_queued = 0;
+    if (--depth[proc->sched_level] == 0) {
+        ready_bitmap &= ~(1U << proc->sched_level);
+    }
+}
+
+/* Move a process to another level, keeping it queued if it was */
+static void set_level(process_t* proc, uint32_t level) {
+    if (proc->sched_level == level) return;
+    
+    if (proc->sched_queued) {
+        dequeue(proc);
+        proc->sched_level = level;
+        enqueue(proc);
+    } else {
+        proc->sched_level = level;
+    }
+}
+
+/* Highest non-empty level (only valid when ready_bitmap is non-zero) */
+static uint32_t top_level(void) {
+    return (uint32_t)__builtin_ctz(ready_bitmap);
+}
+
+/* Wait with interrupts enabled until some process is ready */
+static void scheduler_idle(void) {
+    while (!ready_bitmap) {
+        __asm__ volatile("sti");
+        zpool_refill();
+        __asm__ volatile("cli");
+        if (ready_bitmap) break;
+        
+        /* sti only takes effect after hlt, so no wakeup is lost */
+        __asm__ volatile("sti; hlt; cli");
+    }
+}
+
+/* Take the first process off the highest level and run it */
+static void scheduler_dispatch(void) {
+    uint32_t level = top_level();
+    process_t* next = run_lists[level].head;
+    
+    dequeue(next);
+    dispatches[level]++;
+    slice_left = level_quantum(level);
+    need_resched = 0;
+    
+    if (next == process_get_current()) {
+        next->state = PROCESS_RUNNING;
+        return;
+    }
+    process_switch(next);
+}
 
 /* Initialize scheduler */
 void scheduler_init(void) {
-    kprintf("[SCHED] Initializing scheduler...\n");
-    queue_size = 0;
-    current_index = 0;
+    kprintf("[SCHED] Initializing scheduler (%d levels)...\n", SCHED_LEVELS);
+    
+    for (int i = 0; i < SCHED_LEVELS; i++) {
+        run_lists[i].head = NULL;
+        run_lists[i].tail = NULL;
+        depth[i] = 0;
+        dispatches[i] = 0;
+    }
+    ready_bitmap = 0;
+    slice_left = SCHED_QUANTUM;
+    need_resched = 0;
+    boost_countdown = SCHED_BOOST_PERIOD;
+    
+    /* The kernel process is running, it only needs a level */
+    scheduler_add(process_get_current());
 }
 
 /* Add process to ready queue */
 void scheduler_add(process_t* proc) {
-    if (!proc || queue_size >= MAX_PROCESSES) return;
+    if (!proc) return;
+    
+    uint32_t flags = sched_lock();
+    
+    if (!proc->sched_queued) {
+        proc->sched_level = 0;
+        if (proc->state == PROCESS_READY && proc != process_get_current()) {
+            enqueue(proc);
+        }
+    }
     
-    ready_queue[queue_size++] = proc;
+    sched_unlock(flags);
 }
 
 /* Remove process from ready queue */
 void scheduler_remove(process_t* proc) {
     if (!proc) return;
     
-    for (int i = 0; i < queue_size; i++) {
-        if (ready_queue[i] == proc) {
-            /* Shift remaining processes */
-            for (int j = i; j < queue_size - 1; j++) {
-                ready_queue[j] = ready_queue[j + 1];
-            }
-            queue_size--;
-            
-            /* Adjust current index if needed */
-            if (current_index >= queue_size && queue_size > 0) {
-                current_index = 0;
-            }
-            break;
-        }
+    uint32_t flags = sched_lock();
+    if (proc->sched_queued) {
+        dequeue(proc);
     }
+    sched_unlock(flags);
 }
 
-/* Schedule next process (round-robin) */
+/* Schedule next process */
 void scheduler_schedule(void) {
-    if (queue_size == 0) return;
+    uint32_t flags = sched_lock();
+    process_t* current = process_get_current();
+    
+    if (current && current->state == PROCESS_RUNNING) {
+        /* Keep running if nothing at the same or a higher level waits */
+        if (!ready_bitmap || top_level() > current->sched_level) {
+            slice_left = level_quantum(current->sched_level);
+            need_resched = 0;
+            sched_unlock(flags);
+            return;
+        }
+        enqueue(current);
+    }
     
-    /* Move to next process */
-    current_index = (current_index + 1) % queue_size;
+    scheduler_idle();
+    scheduler_dispatch();
     
-    process_t* next = ready_queue[current_index];
-    if (next && next->state == PROCESS_READY) {
-        process_switch(next);
+    sched_unlock(flags);
+}
+
+/* Account one timer tick to the running process */
+void scheduler_tick(int from_user) {
+    process_t* current = process_get_current();
+    
+    if (--boost_countdown == 0) {
+        boost_countdown = SCHED_BOOST_PERIOD;
+        periodic_boosts++;
+        for (int i = 0; i < process_count(); i++) {
+            set_level(process_get_at(i), 0);
+        }
+    }
+    
+    /* A process that used up its slice drops one level */
+    if (slice_left > 0 && --slice_left == 0 && current &&
+        current->state == PROCESS_RUNNING && current->sched_level < SCHED_LEVELS - 1) {
+        current->sched_level++;
+        demotions++;
+    }
+    
+    /* An expired slice waits for the next tick that lands in user mode */
+    if ((slice_left == 0 || need_resched) && from_user) {
+        scheduler_schedule();
     }
 }
 
 /* Yield CPU voluntarily */
-void scheduler_yield(void) {
-    scheduler_schedule();
-}
\ No newline at end of file
+int scheduler_yield(void) {
+    uint32_t flags = sched_lock();
+    process_t* current = process_get_current();
+    
+    if (!ready_bitmap || !current) {
+        sched_unlock(flags);
+        return 0;
+    }
+    
+    /* Pick among the others first so a high-priority caller really
+     * lets someone else run */
+    uint32_t level = top_level();
+    process_t* next = run_lists[level].head;
+    dequeue(next);
+    dispatches[level]++;
+    if (current->state == PROCESS_RUNNING) {
+        enqueue(current);
+    }
+    slice_left = level_quantum(level);
+    need_resched = 0;
+    process_switch(next);
+    
+    sched_unlock(flags);
+    return 1;
+}
+
+/* Block the current process until scheduler_wakeup */
+void scheduler_block(void) {
+    uint32_t flags = sched_lock();
+    process_t* current = process_get_current();
+    
+    if (!current) {
+        __asm__ volatile("sti; hlt");
+        sched_unlock(flags);
+        return;
+    }
+    
+    if (current->state == PROCESS_RUNNING) {
+        current->state = PROCESS_BLOCKED;
+    }
+    scheduler_idle();
+    scheduler_dispatch();
+    
+    sched_unlock(flags);
+}
+
+/* Make a blocked process ready again */
+void scheduler_wakeup(process_t* proc) {
+    if (!proc) return;
+    
+    uint32_t flags = sched_lock();
+    
+    if (proc->state == PROCESS_BLOCKED) {
+        proc->state = PROCESS_READY;
+        enqueue(proc);
+        
+        process_t* current = process_get_current();
+        if (current && current != proc && proc->sched_level < current->sched_level) {
+            need_resched = 1;
+        }
+    }
+    
+    sched_unlock(flags);
+}
+
+/* Lift an interactive process to the highest level */
+void scheduler_boost(process_t* proc) {
+    if (!proc || proc->sched_level == 0) return;
+    
+    uint32_t flags = sched_lock();
+    set_level(proc, 0);
+    wakeup_boosts++;
+    sched_unlock(flags);
+}
+
+/* Queue depths and counters */
+void scheduler_get_stats(sched_stats_t* stats) {
+    uint32_t flags = sched_lock();
+    
+    for (int i = 0; i < SCHED_LEVELS; i++) {
+        stats->depth[i] = depth[i];
+        stats->dispatches[i] = dispatches[i];
+        stats->quantum[i] = (uint32_t)level_quantum(i);
+    }
+    stats->demotions = demotions;
+    stats->wakeup_boosts = wakeup_boosts;
+    stats->periodic_boosts = periodic_boosts;
+    
+    sched_unlock(flags);
+}
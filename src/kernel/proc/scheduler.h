@@ -5,19 +5,52 @@
 
 #include "process.h"
 
+#define SCHED_LEVELS        4       /* Priority levels, 0 is the highest */
+#define SCHED_QUANTUM       2       /* Ticks per slice at level 0 (doubles per level) */
+#define SCHED_BOOST_PERIOD  100     /* Ticks between moving everyone to level 0 */
+
+typedef struct {
+    uint32_t depth[SCHED_LEVELS];       /* READY processes per level */
+    uint32_t dispatches[SCHED_LEVELS];  /* Times a level was picked to run */
+    uint32_t quantum[SCHED_LEVELS];     /* Slice length in ticks */
+    uint32_t demotions;                 /* Slices used up */
+    uint32_t wakeup_boosts;             /* Interactive wakeups lifted to level 0 */
+    uint32_t periodic_boosts;           /* Anti-starvation resets */
+} sched_stats_t;
+
 /* Initialize scheduler */
 void scheduler_init(void);
 
-/* Add process to scheduler */
+/* Add process to scheduler (at the highest level) */
 void scheduler_add(process_t* proc);
 
 /* Remove process from scheduler */
 void scheduler_remove(process_t* proc);
 
-/* Schedule next process (called from timer interrupt) */
+/* Run the highest-priority ready process; the current one keeps the CPU
+ * if it is still running and nothing of equal or higher priority waits */
 void scheduler_schedule(void);
 
-/* Yield CPU to next process */
-void scheduler_yield(void);
+/* Timer tick: demotes the running process when its time slice is used
+ * up and preempts it on the next tick that interrupts user mode */
+void scheduler_tick(int from_user);
+
+/* Yield CPU to next process; returns 0 if no other process was ready
+ * (the caller may then halt until the next interrupt) */
+int scheduler_yield(void);
+
+/* Put the current process to sleep until scheduler_wakeup. Call with
+ * interrupts disabled after checking the wait condition, and check it
+ * again afterwards. */
+void scheduler_block(void);
+
+/* Make a blocked process ready (safe from interrupt handlers) */
+void scheduler_wakeup(process_t* proc);
+
+/* Move a process to the highest level (interactive wakeups) */
+void scheduler_boost(process_t* proc);
+
+/* Queue depths and per-level counters */
+void scheduler_get_stats(sched_stats_t* stats);
 
-#endif /* SCHEDULER_H */
\ No newline at end of file
+#endif /* SCHEDULER_H */
@@ -3,6 +3,7 @@
 #include "syscall.h"
 #include "../core/idt.h"
 #include "../core/isr.h"
+#include "process.h"
 
 /* External syscall dispatcher from syscall_table.c */
 extern int syscall_dispatch(uint32_t syscall_num, uint32_t arg1, uint32_t arg2, uint32_t arg3);
@@ -20,20 +21,33 @@ void syscall_handler(registers_t* regs) {
     
     /* Return value in EAX */
     regs->eax = ret;
+    
+    /* Killed while the call slept: exit instead of returning */
+    process_t* current = process_get_current();
+    if (current && current->kill_pending) {
+        process_exit(current);
+    }
 }
 
 /* Initialize system call interface */
 void syscall_init(void) {
-    /* Register INT 0x80 handler */
-    idt_set_gate(0x80, (uint32_t)syscall_stub, 0x08, 0x8E);
+    /* Register INT 0x80 handler: DPL 3 so user mode may raise it, and a
+     * trap gate so interrupts stay enabled while a call waits for input */
+    idt_set_gate(0x80, (uint32_t)syscall_stub, 0x08, 0xEF);
 }
 
-/* Assembly stub for system calls */
+/* Assembly stub for system calls: builds the same trap frame as the
+ * interrupt stubs (dummy error code and vector included) */
 __asm__(
     ".global syscall_stub\n"
     "syscall_stub:\n"
+    "   push $0\n"
+    "   push $0x80\n"
     "   pusha\n"
     "   push %ds\n"
+    "   push %es\n"
+    "   push %fs\n"
+    "   push %gs\n"
     "   mov $0x10, %ax\n"
     "   mov %ax, %ds\n"
     "   mov %ax, %es\n"
@@ -42,7 +56,5 @@ __asm__(
     "   push %esp\n"
     "   call syscall_handler\n"
     "   add $4, %esp\n"
-    "   pop %ds\n"
-    "   popa\n"
-    "   iret\n"
+    "   jmp interrupt_return\n"
 );
\ No newline at end of file
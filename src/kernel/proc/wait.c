@@ -0,0 +1,127 @@
+/* wait.c - Wait queues
+ *
+ * A sleeping process is linked into one queue through its own process_t
+ * (wait_next), so queues need no allocation and exit can always unlink
+ * a dead sleeper. Sleepers are BLOCKED and off the scheduler's run lists
+ * until a wake_up makes them READY again; they re-check their condition
+ * after every wakeup, so waking too many is harmless.
+ */
+
+#include "wait.h"
+#include "process.h"
+#include "scheduler.h"
+
+/* Initialize an empty queue */
+void wait_queue_init(wait_queue_t* wq) {
+    wq->head = NULL;
+    wq->tail = NULL;
+}
+
+/* Unlink a process from the queue it sleeps on */
+static void wait_unlink(process_t* proc) {
+    wait_queue_t* wq = proc->wait_queue;
+    process_t** link = &wq->head;
+    process_t* prev = NULL;
+    
+    while (*link && *link != proc) {
+        prev = *link;
+        link = &(*link)->wait_next;
+    }
+    if (*link) {
+        *link = proc->wait_next;
+        if (wq->tail == proc) {
+            wq->tail = prev;
+        }
+    }
+    
+    proc->wait_next = NULL;
+    proc->wait_queue = NULL;
+}
+
+/* Sleep on a queue until woken */
+int wait_sleep(wait_queue_t* wq, int interruptible) {
+    process_t* current = process_get_current();
+    
+    /* Nothing to switch to yet: wait for the next interrupt */
+    if (!current) {
+        __asm__ volatile("sti; hlt; cli");
+        return 0;
+    }
+    
+    if (interruptible && current->kill_pending) return -1;
+    
+    current->wait_next = NULL;
+    current->wait_queue = wq;
+    current->wait_interruptible = (uint8_t)interruptible;
+    if (wq->tail) {
+        wq->tail->wait_next = current;
+    } else {
+        wq->head = current;
+    }
+    wq->tail = current;
+    
+    scheduler_block();
+    
+    /* Woken by something other than this queue */
+    if (current->wait_queue) {
+        wait_unlink(current);
+    }
+    
+    return (interruptible && current->kill_pending) ? -1 : 0;
+}
+
+/* Wake every sleeper, optionally boosting it */
+static void wake_all(wait_queue_t* wq, int boost) {
+    uint32_t flags = wait_irq_save();
+    
+    process_t* proc = wq->head;
+    wq->head = NULL;
+    wq->tail = NULL;
+    
+    while (proc) {
+        process_t* next = proc->wait_next;
+        proc->wait_next = NULL;
+        proc->wait_queue = NULL;
+        if (boost) {
+            scheduler_boost(proc);
+        }
+        scheduler_wakeup(proc);
+        proc = next;
+    }
+    
+    wait_irq_restore(flags);
+}
+
+/* Wake every process sleeping on a queue */
+void wake_up(wait_queue_t* wq) {
+    wake_all(wq, 0);
+}
+
+/* Wake every process sleeping on a queue at top priority */
+void wake_up_interactive(wait_queue_t* wq) {
+    wake_all(wq, 1);
+}
+
+/* Take a process off its queue */
+void wait_remove(process_t* proc) {
+    uint32_t flags = wait_irq_save();
+    if (proc->wait_queue) {
+        wait_unlink(proc);
+    }
+    wait_irq_restore(flags);
+}
+
+/* End an interruptible sleep early */
+int wait_interrupt(process_t* proc) {
+    uint32_t flags = wait_irq_save();
+    
+    int interrupted = 0;
+    if (proc->wait_queue && proc->wait_interruptible) {
+        wait_unlink(proc);
+        scheduler_wakeup(proc);
+        interrupted = 1;
+    }
+    
+    wait_irq_restore(flags);
+    return interrupted;
+}
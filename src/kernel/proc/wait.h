@@ -0,0 +1,77 @@
+/* wait.h - Wait queues for blocking in the kernel */
+
+#ifndef WAIT_H
+#define WAIT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct process;
+
+/* Processes sleeping until an event, linked through process_t */
+typedef struct wait_queue {
+    struct process* head;
+    struct process* tail;
+} wait_queue_t;
+
+#define WAIT_QUEUE_INIT { NULL, NULL }
+
+/* Disable interrupts, returning the previous flags */
+static inline uint32_t wait_irq_save(void) {
+    uint32_t flags;
+    __asm__ volatile("pushf; pop %0; cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+/* Restore the flags saved by wait_irq_save */
+static inline void wait_irq_restore(uint32_t flags) {
+    __asm__ volatile("push %0; popf" :: "r"(flags) : "memory", "cc");
+}
+
+/* Initialize an empty queue */
+void wait_queue_init(wait_queue_t* wq);
+
+/* Sleep on wq until woken. Call with interrupts disabled after checking
+ * the wait condition. An interruptible sleep also ends when the process
+ * is killed, and then returns -1. */
+int wait_sleep(wait_queue_t* wq, int interruptible);
+
+/* Wake every process sleeping on wq (safe from interrupt handlers) */
+void wake_up(wait_queue_t* wq);
+
+/* Like wake_up, also lifting the sleepers to the highest scheduler level
+ * (for input that a user is waiting on) */
+void wake_up_interactive(wait_queue_t* wq);
+
+/* Take a process off whatever queue it sleeps on (exit) */
+void wait_remove(struct process* proc);
+
+/* End an interruptible sleep early; returns 0 if proc was not in one */
+int wait_interrupt(struct process* proc);
+
+/* Sleep on wq until condition holds */
+#define wait_event(wq, condition)                                   \
+    do {                                                            \
+        uint32_t __flags = wait_irq_save();                         \
+        while (!(condition)) {                                      \
+            wait_sleep(&(wq), 0);                                   \
+        }                                                           \
+        wait_irq_restore(__flags);                                  \
+    } while (0)
+
+/* Sleep on wq until condition holds or the process is killed; evaluates
+ * to 0, or -1 if the sleep was interrupted */
+#define wait_event_interruptible(wq, condition) ({                  \
+        int __ret = 0;                                              \
+        uint32_t __flags = wait_irq_save();                         \
+        while (!(condition)) {                                      \
+            if (wait_sleep(&(wq), 1) < 0) {                         \
+                __ret = -1;                                         \
+                break;                                              \
+            }                                                       \
+        }                                                           \
+        wait_irq_restore(__flags);                                  \
+        __ret;                                                      \
+    })
+
+#endif /* WAIT_H */
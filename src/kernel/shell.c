@@ -4,11 +4,16 @@
 #include "core/console.h"
 #include "core/keyboard.h"
 #include "mm/memory.h"
+#include "mm/pmm.h"
 #include "mm/heap.h"
+#include "mm/slab.h"
+#include "mm/zpool.h"
+#include "mm/swap.h"
 #include "core/timer.h"
 #include "fs/initrd.h"
 #include "fs/vfs.h"
 #include "proc/process.h"
+#include "proc/scheduler.h"
 #include "proc/elf.h"
 
 /* CPU vendor string retrieval */
@@ -68,7 +73,11 @@ static void cmd_help(void) {
     kprintf("\nProcess Management:\n");
     kprintf("  ps       - List running processes\n");
     kprintf("  kill     - Kill a process by PID\n");
+    kprintf("  sched    - Show scheduler queues and priorities\n");
     kprintf("  meminfo  - Show detailed memory info\n");
+    kprintf("  heapchunk - Show/set heap growth step (KB)\n");
+    kprintf("  slabinfo  - Show kernel object cache statistics\n");
+    kprintf("  heapprof  - Show top heap consumers and fragmentation\n");
     kprintf("  exec     - Execute a program\n");
     kprintf("\nApplications (run with full path or use exec):\n");
     kprintf("  /bin/calculator   - Calculator\n");
@@ -86,9 +95,9 @@ static void cmd_mem(void) {
     uint32_t free = memory_get_free();
     
     kprintf("Memory Statistics:\n");
-    kprintf("  Total: %u KB\n", total / 1024);
-    kprintf("  Used:  %u KB\n", used / 1024);
-    kprintf("  Free:  %u KB\n", free / 1024);
+    kprintf("  Total: %u KB\n", total);
+    kprintf("  Used:  %u KB\n", used);
+    kprintf("  Free:  %u KB\n", free);
 }
 
 /* Command: meminfo - detailed */
@@ -98,18 +107,144 @@ static void cmd_meminfo(void) {
     uint32_t free = memory_get_free();
     uint32_t heap_used = heap_get_used();
     uint32_t heap_free = heap_get_free();
+    zpool_stats_t zpool;
+    zpool_get_stats(&zpool);
+    swap_stats_t swap;
+    swap_get_stats(&swap);
+    
+    /* Paging rates over the time since the previous meminfo */
+    static uint32_t last_ms = 0, last_in = 0, last_out = 0;
+    uint32_t now = timer_get_uptime_ms();
+    uint32_t elapsed = now - last_ms ? now - last_ms : 1;
+    uint32_t in_rate = (swap.pages_in - last_in) * 1000 / elapsed;
+    uint32_t out_rate = (swap.pages_out - last_out) * 1000 / elapsed;
+    last_ms = now;
+    last_in = swap.pages_in;
+    last_out = swap.pages_out;
     
     kprintf("Detailed Memory Information:\n");
     kprintf("  Physical Memory:\n");
-    kprintf("    Total:     %u KB (%u MB)\n", total / 1024, total / (1024*1024));
-    kprintf("    Used:      %u KB\n", used / 1024);
-    kprintf("    Free:      %u KB\n", free / 1024);
+    kprintf("    Total:     %u KB (%u MB)\n", total, total / 1024);
+    kprintf("    Used:      %u KB\n", used);
+    kprintf("    Free:      %u KB\n", free);
+    kprintf("    Low zone:  %u/%u KB free\n",
+            pmm_get_free_pages(PMM_ZONE_LOW) * 4, pmm_get_total_pages(PMM_ZONE_LOW) * 4);
+    kprintf("    High zone: %u/%u KB free\n",
+            pmm_get_free_pages(PMM_ZONE_HIGH) * 4, pmm_get_total_pages(PMM_ZONE_HIGH) * 4);
     kprintf("  Heap:\n");
     kprintf("    Used:      %u KB\n", heap_used / 1024);
     kprintf("    Free:      %u KB\n", heap_free / 1024);
+    kprintf("    Mapped:    %u KB\n", heap_get_size() / 1024);
+    kprintf("    Peak:      %u KB\n", heap_get_high_water() / 1024);
+    kprintf("    Chunk:     %u KB\n", heap_get_growth_chunk() / 1024);
+    kprintf("  Zero pool:\n");
+    kprintf("    Ready:     %u/%u frames\n", zpool.count, zpool.capacity);
+    kprintf("    Hits:      %u\n", zpool.hits);
+    kprintf("    Misses:    %u\n", zpool.misses);
+    kprintf("  Swap:\n");
+    if (swap.total_slots) {
+        kprintf("    Used:      %u/%u KB\n", swap.used_slots * 4, swap.total_slots * 4);
+        kprintf("    Page-ins:  %u (%u/s, %u reads)\n", swap.pages_in, in_rate, swap.reads);
+        kprintf("    Page-outs: %u (%u/s, %u writes)\n", swap.pages_out, out_rate, swap.writes);
+    } else {
+        kprintf("    None\n");
+    }
     kprintf("  Pages:\n");
     kprintf("    Page Size: 4 KB\n");
-    kprintf("    Total:     %u pages\n", total / 4096);
+    kprintf("    Total:     %u pages\n", total / 4);
+}
+
+/* Command: heapchunk - show or tune heap growth step */
+static void cmd_heapchunk(const char* args) {
+    if (*args) {
+        int kb = atoi(args);
+        if (kb <= 0) {
+            kprintf("Usage: heapchunk [KB]\n");
+            return;
+        }
+        heap_set_growth_chunk((uint32_t)kb * 1024);
+    }
+    
+    kprintf("Heap growth chunk: %u KB\n", heap_get_growth_chunk() / 1024);
+}
+
+/* Command: slabinfo - per-cache object statistics */
+static void cmd_slabinfo(void) {
+    uint32_t count = kmem_cache_count();
+    kmem_cache_info_t info;
+    
+    kprintf("Object caches (%u):\n", count);
+    
+    for (uint32_t i = 0; i < count; i++) {
+        if (kmem_cache_get_info(i, &info) < 0) continue;
+        
+        kprintf("  %s: %u bytes, %u/%u objects, %u slabs x %u KB (%u/slab), waste %u bytes\n",
+                info.name, info.object_size,
+                info.active_objects, info.total_objects,
+                info.slabs, info.slab_size / 1024, info.objects_per_slab,
+                info.waste);
+    }
+}
+
+/* Command: heapprof - top allocation sites and free-block histogram */
+static void cmd_heapprof(const char* args) {
+    heap_site_info_t sites[16];
+    uint32_t max = 10;
+    
+    if (*args) {
+        int n = atoi(args);
+        if (n <= 0 || n > 16) {
+            kprintf("Usage: heapprof [1-16]\n");
+            return;
+        }
+        max = (uint32_t)n;
+    }
+    
+#ifdef HEAP_PROFILE
+    uint32_t count = heap_profile_sites(sites, max);
+    kprintf("Top heap consumers (live/peak bytes, live blocks, allocations):\n");
+    for (uint32_t i = 0; i < count; i++) {
+        if (sites[i].caller) {
+            kprintf("  0x%x: %u / %u, %u blocks, %u allocs\n", sites[i].caller,
+                    sites[i].live_bytes, sites[i].peak_bytes,
+                    sites[i].live_blocks, sites[i].allocs);
+        } else {
+            kprintf("  (other): %u / %u, %u blocks, %u allocs\n",
+                    sites[i].live_bytes, sites[i].peak_bytes,
+                    sites[i].live_blocks, sites[i].allocs);
+        }
+    }
+    
+    kprintf("Live blocks by size class:\n");
+    for (uint32_t c = 0; c < heap_profile_class_count(); c++) {
+        uint32_t live = heap_profile_class_live(c);
+        if (live) {
+            kprintf("  >= %u bytes: %u\n", heap_profile_class_base(c), live);
+        }
+    }
+#else
+    (void)sites;
+    (void)max;
+    kprintf("Call-site profiling disabled (build with HEAP_PROFILE=1)\n");
+#endif
+    
+    uint32_t histogram[24];
+    uint32_t largest;
+    heap_get_free_histogram(histogram, 24, &largest);
+    
+    kprintf("Free blocks by size:\n");
+    for (uint32_t i = 0; i < 24; i++) {
+        if (histogram[i]) {
+            kprintf("  >= %u bytes: %u\n", 1U << i, histogram[i]);
+        }
+    }
+    
+    /* Fragmentation: share of free memory outside the largest block */
+    uint32_t free = heap_get_free();
+    uint32_t frag = free >= 100 ? (free - largest) / (free / 100) : 0;
+    if (frag > 100) frag = 100;
+    kprintf("Free %u bytes, largest block %u bytes, fragmentation %u%%\n",
+            free, largest, frag);
 }
 
 /* Command: uptime */
@@ -201,6 +336,26 @@ static void cmd_ps(void) {
     process_list_all();
 }
 
+/* Command: sched - run queue depths, dispatch counts and priorities */
+static void cmd_sched(void) {
+    sched_stats_t stats;
+    scheduler_get_stats(&stats);
+    
+    kprintf("Level  Slice  Ready  Dispatches\n");
+    for (int i = 0; i < SCHED_LEVELS; i++) {
+        kprintf("  %d    %u ms  %u      %u\n", i, stats.quantum[i] * (1000 / TIMER_FREQ),
+                stats.depth[i], stats.dispatches[i]);
+    }
+    kprintf("Demotions: %u, input boosts: %u, periodic boosts: %u\n",
+            stats.demotions, stats.wakeup_boosts, stats.periodic_boosts);
+    
+    kprintf("Processes:\n");
+    for (int i = 0; i < process_count(); i++) {
+        process_t* p = process_get_at(i);
+        kprintf("  PID %d (%s): level %u\n", p->pid, p->name, p->sched_level);
+    }
+}
+
 /* Command: kill - kill process */
 static void cmd_kill(const char* args) {
     if (!*args) {
@@ -242,20 +397,13 @@ static void cmd_exec(const char* args) {
         return;
     }
     
-    /* Create process */
-    process_t* proc = process_create(args);
-    if (!proc) {
-        kprintf("Error: Failed to create process\n");
-        return;
-    }
-    
-    /* Execute program */
-    kprintf("Executing: %s (PID %d)\n", args, proc->pid);
+    /* Start it in a fresh child process */
+    kprintf("Executing: %s\n", args);
     
     char* argv[] = { (char*)args, NULL };
-    if (process_exec(proc, args, argv) < 0) {
+    process_t* proc = process_spawn(process_get_current(), args, argv, NULL);
+    if (!proc) {
         kprintf("Error: Failed to execute %s\n", args);
-        process_kill(proc->pid, 9);
         return;
     }
     
@@ -296,6 +444,12 @@ static void execute_command(char* input) {
         cmd_mem();
     } else if (strcmp(input, "meminfo") == 0) {
         cmd_meminfo();
+    } else if (strcmp(input, "heapchunk") == 0) {
+        cmd_heapchunk(args);
+    } else if (strcmp(input, "slabinfo") == 0) {
+        cmd_slabinfo();
+    } else if (strcmp(input, "heapprof") == 0) {
+        cmd_heapprof(args);
     } else if (strcmp(input, "uptime") == 0) {
         cmd_uptime();
     } else if (strcmp(input, "echo") == 0) {
@@ -310,6 +464,8 @@ static void execute_command(char* input) {
         cmd_clear();
     } else if (strcmp(input, "ps") == 0) {
         cmd_ps();
+    } else if (strcmp(input, "sched") == 0) {
+        cmd_sched();
     } else if (strcmp(input, "kill") == 0) {
         cmd_kill(args);
     } else if (strcmp(input, "exec") == 0) {